@@ -1,9 +1,5 @@
 #undef _GLIBCXX_DEBUG
 #pragma GCC optimize "Ofast,unroll-loops,omit-frame-pointer,inline"
-#pragma GCC option("arch=native", "tune=native", "no-zero-upper")
-#ifndef POPCNT
-#pragma GCC target("movbe,aes,pclmul,avx,avx2,f16c,fma,sse3,ssse3,sse4.1,sse4.2,rdrnd,popcnt,bmi,bmi2,lzcnt")
-#endif
 
 #include <iostream>
 #include <array>
@@ -12,11 +8,51 @@
 #include <cstdlib>
 #include <strings.h>
 #include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <type_traits>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <emmintrin.h>
 
 typedef uint32_t State;
 typedef uint32_t Count;
 typedef std::array<Count, 8> CountArray;
 
+// Eight 32-bit lanes. GCC vector extensions compile to one AVX2/AVX-512 register op or to two
+// SSE2 ops, depending on the clone they are inlined into.
+typedef uint32_t LaneVector __attribute__((vector_size(32)));
+typedef int32_t LaneMask __attribute__((vector_size(32)));
+
+// No global target pragma: the entry points of the hot loops are compiled once per x86-64 level
+// (v4: AVX-512, v3: AVX2/BMI2/FMA, baseline) and the loader picks one from cpuid at startup
+// (GCC function multi-versioning). The kernels they call are plain or vector-extension code and
+// only get the clone's instruction set when inlined, which GCC's heuristics would not do for the
+// larger ones (move generation, canonicalize_batch, the layer inserts), so flatten forces it.
+#define MULTIVERSION __attribute__((flatten, target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+
+// The clone the dispatcher runs on this CPU, for --stats.
+const char *cpu_level() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("x86-64-v4"))
+        return "x86-64-v4";
+    if (__builtin_cpu_supports("x86-64-v3"))
+        return "x86-64-v3";
+    return "default";
+}
+
 #define GET_DIE_VALUE(state, position) (((state) >> ((position) * 3)) & 0b111)
 #define CLEAR_DIE_VALUE(state, position) ((state) & ~(0b111 << ((position) * 3)))
 #define SET_DIE_VALUE(state, position, value) ((state) | ((value) << ((position) * 3)))
@@ -51,7 +87,8 @@ const std::array<State, 9> neighbors_mask = {
     0b000'111'000'111'000'000'000'000'000
 };
 
-const std::array<uint8_t, 64> symmetric_mult = {
+// 32-bit entries so that a row loads directly as an AVX2 permutation.
+alignas(32) const std::array<uint32_t, 64> symmetric_mult = {
     0, 1, 2, 3, 4, 5, 6, 7,
     1, 0, 3, 2, 6, 7, 4, 5,
     2, 3, 0, 1, 5, 4, 7, 6,
@@ -67,15 +104,17 @@ constexpr uint64_t MOD = 1ULL << 30;
 //
 // A helper to compute all eight symmetric transformations for a given state.
 // These transformations are exactly the same as those in your original get_symmetric_state.
-inline void compute_symmetries(State s, State sym[8]) {
+// T is State, or LaneVector to transform 8 states at once.
+template <typename T>
+inline void compute_symmetries(const T &s, T sym[8]) {
     sym[0] = s;
     sym[1] = (((s & MASK_ROW_2) >> 18) | ((s & MASK_ROW_0) << 18) | (s & MASK_ROW_1));
     sym[2] = (((s & MASK_COL_0) << 6) | ((s & MASK_COL_2) >> 6) | (s & MASK_COL_1));
-    { State tmp = sym[1];
+    { const T tmp = sym[1];
       sym[3] = (((tmp & MASK_COL_0) << 6) | ((tmp & MASK_COL_2) >> 6) | (tmp & MASK_COL_1)); }
     sym[4] = ((s & (MASK_0|MASK_4|MASK_8)) | (((s) & (MASK_1|MASK_5)) << 6) |
               (((s) & MASK_2) << 12) | (((s) & MASK_6) >> 12) | (((s) & (MASK_3|MASK_7)) >> 6));
-    { State tmp = sym[4];
+    { const T tmp = sym[4];
       sym[5] = (((tmp & MASK_ROW_2) >> 18) | ((tmp & MASK_ROW_0) << 18) | (tmp & MASK_ROW_1)); }
     sym[6] = (((s & (MASK_0|MASK_5)) << 6) | ((s & MASK_1) << 12) | ((s & MASK_2) << 18) |
               (((s) & (MASK_3|MASK_8)) >> 6) | (s & MASK_4) | (((s)&MASK_6)>>18) | (((s)&MASK_7)>>12));
@@ -83,24 +122,136 @@ inline void compute_symmetries(State s, State sym[8]) {
               (((s)&(MASK_5|MASK_7)) >> 12) | (((s)&MASK_8)>>24));
 }
 
-// --- HashTable (unchanged) ---
+// --- Batched canonicalization ---
+// Canonical form (smallest of the eight symmetric states) and the index of the symmetry reaching it,
+// for n states at once. Ties keep the lowest index, like a scalar strict '<' scan. Each lane holds
+// one state and compute_symmetries runs on 8 states per iteration; states fit in 27 bits, so signed
+// compares are safe. A tail shorter than 8 goes through the scalar loop.
+inline void canonicalize_batch_scalar(const State *states, const int n, State *canonical, uint32_t *sym_index) {
+    for (int k = 0; k < n; k++) {
+        State sym[8];
+        compute_symmetries(states[k], sym);
+        State canonical_state = sym[0];
+        int canonical_index = 0;
+        for (int i = 1; i < 8; i++) {
+            if (sym[i] < canonical_state) {
+                canonical_state = sym[i];
+                canonical_index = i;
+            }
+        }
+        canonical[k] = canonical_state;
+        sym_index[k] = canonical_index;
+    }
+}
+
+inline void canonicalize_batch(const State *states, const int n, State *canonical, uint32_t *sym_index) {
+    int k = 0;
+    for (; k + 8 <= n; k += 8) {
+        LaneVector s;
+        memcpy(&s, states + k, sizeof(s));
+        LaneVector sym[8];
+        compute_symmetries(s, sym);
+        LaneVector best = sym[0];
+        LaneVector index = {};
+        for (int i = 1; i < 8; i++) {
+            const LaneVector less = (LaneVector)((LaneMask)sym[i] < (LaneMask)best);
+            best = (sym[i] & less) | (best & ~less);
+            index = (LaneVector(index - index + i) & less) | (index & ~less);
+        }
+        memcpy(canonical + k, &best, sizeof(best));
+        memcpy(sym_index + k, &index, sizeof(index));
+    }
+    canonicalize_batch_scalar(states + k, n - k, canonical + k, sym_index + k);
+}
+
+// --- Count vector kernels ---
+// A CountArray is exactly one LaneVector: accumulation, the symmetric_mult permutation and the
+// terminal weighting are one instruction each with AVX2. All arithmetic wraps modulo 2^32. They
+// only get AVX2 inside a MULTIVERSION clone, so every loop running them is one or inlines into one.
+inline void add_counts(Count *dst, const Count *src) {
+    LaneVector a, b;
+    memcpy(&a, dst, sizeof(a));
+    memcpy(&b, src, sizeof(b));
+    a += b;
+    memcpy(dst, &a, sizeof(a));
+}
+
+// dst[i] = counts[lanes[i]], lanes being a row such as symmetric_mult[canonical_index * 8]
+inline void remap_counts(Count *dst, const Count *counts, const uint32_t *lanes) {
+    LaneVector c, l;
+    memcpy(&c, counts, sizeof(c));
+    memcpy(&l, lanes, sizeof(l));
+    c = __builtin_shuffle(c, l);
+    memcpy(dst, &c, sizeof(c));
+}
+
+// sum of hashes[i] * counts[i]
+inline uint32_t weight_counts(const uint32_t *hashes, const Count *counts) {
+    LaneVector h, c;
+    memcpy(&h, hashes, sizeof(h));
+    memcpy(&c, counts, sizeof(c));
+    h *= c;
+    uint32_t sum = 0;
+    for (int i = 0; i < 8; i++) {
+        sum += h[i];
+    }
+    return sum;
+}
+
+// --- HashTable ---
+// Open addressing over a power-of-two number of slots, probed by groups of 16 slots.
+// Every slot owns one control byte: EMPTY, or the 7 high bits of the state hash. A lookup compares
+// the tag against a whole group with one SSE2 compare and only checks the matching slots; the first
+// group that still has an empty slot ends the probe. There is no deletion, so no tombstones.
+// keys[i] is the slot of the i-th inserted state, table[slot] = state | storage_index << 32 and the
+// counts live in storage[storage_index .. +8], as before.
+struct ProbeStats {
+    uint64_t lookups = 0;
+    uint64_t groups = 0;
+    uint32_t max_groups = 0;
+    uint32_t rehashes = 0;
+    uint32_t storage_growths = 0;
+
+    inline void add(const ProbeStats &other) {
+        lookups += other.lookups;
+        groups += other.groups;
+        max_groups = std::max(max_groups, other.max_groups);
+        rehashes += other.rehashes;
+        storage_growths += other.storage_growths;
+    }
+};
+
+inline uint32_t hash_state(State state) {
+    state ^= state >> 16;
+    state *= 0x85EBCA6B;
+    state ^= state >> 13;
+    state *= 0xC2B2AE35;
+    state ^= state >> 16;
+    return state;
+}
+
 struct HashTable {
-    const uint32_t max_size = 100000;
+    static constexpr uint32_t GROUP_SIZE = 16;
+    static constexpr uint32_t INITIAL_CAPACITY = 1 << 17;
+    static constexpr uint8_t EMPTY = 0x80;
+
+    uint32_t capacity;
     uint32_t *keys;
     uint64_t *table;
+    uint8_t *control;
     size_t count;
 
     uint32_t* storage;
     uint32_t storage_capacity;
     uint32_t next_storage_index;
 
-    HashTable() {
+    ProbeStats stats;
+
+    explicit HashTable(uint32_t initial_capacity = INITIAL_CAPACITY) {
         count = 0;
-        keys = new uint32_t[max_size];
-        table = new uint64_t[max_size];
-        memset(table, 0, max_size * sizeof(uint64_t));
-        
-        storage_capacity = max_size * 8;
+        allocate(initial_capacity);
+
+        storage_capacity = capacity * 8;
         storage = new uint32_t[storage_capacity];
         next_storage_index = 0;
     }
@@ -108,6 +259,7 @@ struct HashTable {
     ~HashTable() {
         delete[] keys;
         delete[] table;
+        delete[] control;
         delete[] storage;
     }
 
@@ -116,29 +268,99 @@ struct HashTable {
     HashTable(HashTable&&) = delete;
     HashTable& operator=(HashTable&&) = delete;
 
-    inline void insert(const State& new_state, const CountArray& value) {
-        uint32_t hash = new_state % max_size;
-        while (table[hash] != 0) {
-            const uint64_t pair = table[hash];
-            const State state = pair & 0xFFFFFFFF;
-            if (state == new_state) {
-                const uint32_t index = (pair >> 32) & 0xFFFFFFFF;
-                for (int j = 0; j < 8; j++) {
-                    storage[index + j] += value[j];
+    inline void allocate(uint32_t new_capacity) {
+        capacity = new_capacity;
+        keys = new uint32_t[capacity];
+        table = new uint64_t[capacity];
+        control = new uint8_t[capacity];
+        memset(control, EMPTY, capacity);
+    }
+
+    // Returns the slot holding new_state, or the empty slot where it must go.
+    inline uint32_t find_slot(const State new_state) {
+        const uint32_t hash = hash_state(new_state);
+        const __m128i tag = _mm_set1_epi8(char(hash >> 25));
+        const uint32_t group_mask = capacity / GROUP_SIZE - 1;
+        uint32_t group = hash & group_mask;
+        for (uint32_t step = 1;; step++) {
+            const __m128i ctrl = _mm_loadu_si128((const __m128i *)(control + group * GROUP_SIZE));
+            uint32_t match = _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, tag));
+            while (match) {
+                const uint32_t slot = group * GROUP_SIZE + __builtin_ctz(match);
+                if (State(table[slot]) == new_state) {
+                    record_probe(step);
+                    return slot;
                 }
-                return;
+                match &= match - 1;
             }
-            hash++;
-            if (hash >= max_size)
-                hash = 0;
+            const uint32_t empty = _mm_movemask_epi8(ctrl);
+            if (empty) {
+                record_probe(step);
+                return group * GROUP_SIZE + __builtin_ctz(empty);
+            }
+            group = (group + step) & group_mask;
+        }
+    }
+
+    // Returns the first empty slot on the probe sequence of a state known to be absent. Rehashing
+    // uses it, so it skips the tag compares and leaves the probe statistics alone.
+    inline uint32_t find_empty_slot(const State new_state) const {
+        const uint32_t group_mask = capacity / GROUP_SIZE - 1;
+        uint32_t group = hash_state(new_state) & group_mask;
+        for (uint32_t step = 1;; step++) {
+            const __m128i ctrl = _mm_loadu_si128((const __m128i *)(control + group * GROUP_SIZE));
+            const uint32_t empty = _mm_movemask_epi8(ctrl);
+            if (empty)
+                return group * GROUP_SIZE + __builtin_ctz(empty);
+            group = (group + step) & group_mask;
+        }
+    }
+
+    inline void record_probe(uint32_t groups) {
+        stats.lookups++;
+        stats.groups += groups;
+        if (groups > stats.max_groups)
+            stats.max_groups = groups;
+    }
+
+    inline void insert(const State& new_state, const CountArray& value) {
+        uint32_t slot = find_slot(new_state);
+        if (control[slot] != EMPTY) {
+            const uint32_t index = (table[slot] >> 32) & 0xFFFFFFFF;
+            add_counts(storage + index, value.data());
+            return;
+        }
+        if ((count + 1) * 8 > size_t(capacity) * 7) {
+            rehash(capacity * 2);
+            slot = find_slot(new_state);
         }
-        keys[count] = hash;
+        keys[count] = slot;
         uint32_t storage_index = get_next_storage_index();
         memcpy(storage + storage_index, value.data(), 8 * sizeof(Count));
-        table[hash] = uint64_t(new_state) | (uint64_t(storage_index) << 32);
+        control[slot] = uint8_t(hash_state(new_state) >> 25);
+        table[slot] = uint64_t(new_state) | (uint64_t(storage_index) << 32);
         count++;
     }
 
+    // Moves every state to a table of new_capacity slots, keeping the insertion order of keys.
+    void rehash(uint32_t new_capacity) {
+        uint32_t *old_keys = keys;
+        uint64_t *old_table = table;
+        uint8_t *old_control = control;
+        allocate(new_capacity);
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t pair = old_table[old_keys[i]];
+            const uint32_t slot = find_empty_slot(State(pair));
+            control[slot] = uint8_t(hash_state(State(pair)) >> 25);
+            table[slot] = pair;
+            keys[i] = slot;
+        }
+        delete[] old_keys;
+        delete[] old_table;
+        delete[] old_control;
+        stats.rehashes++;
+    }
+
     inline uint32_t get_next_storage_index() {
         if (next_storage_index + 8 > storage_capacity) {
             storage_capacity *= 2;
@@ -146,6 +368,7 @@ struct HashTable {
             memcpy(new_storage, storage, next_storage_index * sizeof(uint32_t));
             delete[] storage;
             storage = new_storage;
+            stats.storage_growths++;
         }
         uint32_t index = next_storage_index;
         next_storage_index += 8;
@@ -153,71 +376,427 @@ struct HashTable {
     }
 
     inline void clear() {
-        memset(table, 0, max_size * sizeof(uint64_t));
+        memset(control, EMPTY, capacity);
         count = 0;
         next_storage_index = 0;
     }
 };
 
 inline void swap_hash_table(HashTable &a, HashTable &b) {
+    std::swap(a.capacity, b.capacity);
     std::swap(a.keys, b.keys);
     std::swap(a.table, b.table);
+    std::swap(a.control, b.control);
     std::swap(a.storage, b.storage);
     std::swap(a.count, b.count);
     std::swap(a.storage_capacity, b.storage_capacity);
     std::swap(a.next_storage_index, b.next_storage_index);
+    std::swap(a.stats, b.stats);
 }
 
+// --- Dense layers ---
+// Every board is a base-7 number of nine digits, so 7^9 indices cover them all. StateRanking marks
+// the canonical ones in a bitmap and ranks them densely with a prefix count per 64-bit word plus a
+// popcount: rank() is a handful of loads and no probing. canonical_states is the inverse mapping.
+// The bitmap takes 5 MB and can be cached in a file, the rest is derived from it.
+struct StateRanking {
+    static constexpr uint32_t BOARD_COUNT = 40353607;
+    static constexpr uint32_t WORD_COUNT = (BOARD_COUNT + 63) / 64;
+    static constexpr uint32_t CACHE_MAGIC = 0x43455048;
+
+    uint32_t row_index[3][512];
+    std::vector<uint64_t> canonical_bits;
+    std::vector<uint32_t> rank_prefix;
+    std::vector<State> canonical_states;
+
+    StateRanking() {
+        for (int row = 0; row < 3; row++) {
+            uint32_t power = 1;
+            for (int i = 0; i < row * 3; i++)
+                power *= 7;
+            for (uint32_t bits = 0; bits < 512; bits++)
+                row_index[row][bits] = ((bits & 7) + ((bits >> 3) & 7) * 7 + ((bits >> 6) & 7) * 49) * power;
+        }
+    }
+
+    inline uint32_t index(const State state) const {
+        return row_index[0][state & 511] + row_index[1][(state >> 9) & 511] + row_index[2][(state >> 18) & 511];
+    }
+
+    inline uint32_t rank(const State state) const {
+        const uint32_t i = index(state);
+        return rank_prefix[i >> 6] + __builtin_popcountll(canonical_bits[i >> 6] & ((uint64_t(1) << (i & 63)) - 1));
+    }
+
+    inline uint32_t size() const { return uint32_t(canonical_states.size()); }
+
+    // Walks the boards in index order, 8 at a time through canonicalize_batch.
+    MULTIVERSION void build() {
+        canonical_bits.assign(WORD_COUNT, 0);
+        alignas(32) State boards[8];
+        State canonical[8];
+        uint32_t sym_index[8];
+        int digits[9] = {0};
+        State state = 0;
+        for (uint32_t i = 0; i < BOARD_COUNT; i += 8) {
+            const int n = int(std::min<uint32_t>(8, BOARD_COUNT - i));
+            for (int k = 0; k < n; k++) {
+                boards[k] = state;
+                for (int p = 0; p < 9; p++) {
+                    if (++digits[p] < 7) {
+                        state += State(1) << (p * 3);
+                        break;
+                    }
+                    digits[p] = 0;
+                    state &= ~(State(0b111) << (p * 3));
+                }
+            }
+            canonicalize_batch(boards, n, canonical, sym_index);
+            for (int k = 0; k < n; k++)
+                if (canonical[k] == boards[k])
+                    canonical_bits[(i + k) >> 6] |= uint64_t(1) << ((i + k) & 63);
+        }
+        derive();
+    }
+
+    void derive() {
+        rank_prefix.assign(WORD_COUNT, 0);
+        canonical_states.clear();
+        uint32_t total = 0;
+        for (uint32_t w = 0; w < WORD_COUNT; w++) {
+            rank_prefix[w] = total;
+            total += __builtin_popcountll(canonical_bits[w]);
+        }
+        canonical_states.reserve(total);
+        for (uint32_t w = 0; w < WORD_COUNT; w++) {
+            for (uint64_t bits = canonical_bits[w]; bits; bits &= bits - 1) {
+                uint32_t i = w * 64 + __builtin_ctzll(bits);
+                State state = 0;
+                for (int p = 0; p < 9; p++, i /= 7)
+                    state |= State(i % 7) << (p * 3);
+                canonical_states.push_back(state);
+            }
+        }
+    }
+
+    bool load(const char *path) {
+        std::ifstream file(path, std::ios::binary);
+        uint32_t header[2];
+        if (!file.read((char *)header, sizeof(header)) || header[0] != CACHE_MAGIC || header[1] != BOARD_COUNT)
+            return false;
+        canonical_bits.resize(WORD_COUNT);
+        if (!file.read((char *)canonical_bits.data(), WORD_COUNT * sizeof(uint64_t)))
+            return false;
+        derive();
+        return true;
+    }
+
+    void save(const char *path) const {
+        std::ofstream file(path, std::ios::binary);
+        const uint32_t header[2] = {CACHE_MAGIC, BOARD_COUNT};
+        file.write((const char *)header, sizeof(header));
+        file.write((const char *)canonical_bits.data(), WORD_COUNT * sizeof(uint64_t));
+    }
+};
+
+// A layer as flat count arrays indexed by rank, with an occupancy bitmap of the live ranks.
+// Counts are zeroed as they are consumed, so a layer is empty again once it has been expanded.
+struct DenseLayer {
+    const StateRanking *ranking;
+    Count *counts;
+    uint64_t *occupied;
+    uint32_t word_count;
+    size_t count;
+
+    explicit DenseLayer(const StateRanking &r) : ranking(&r), count(0) {
+        word_count = (r.size() + 63) / 64;
+        counts = (Count *)calloc(size_t(r.size()) * 8, sizeof(Count));
+        occupied = (uint64_t *)calloc(word_count, sizeof(uint64_t));
+    }
+
+    ~DenseLayer() {
+        free(counts);
+        free(occupied);
+    }
+
+    DenseLayer(const DenseLayer&) = delete;
+    DenseLayer& operator=(const DenseLayer&) = delete;
+
+    inline void insert(const State& new_state, const CountArray& value) {
+        const uint32_t rank = ranking->rank(new_state);
+        uint64_t &word = occupied[rank >> 6];
+        const uint64_t bit = uint64_t(1) << (rank & 63);
+        count += !(word & bit);
+        word |= bit;
+        add_counts(counts + size_t(rank) * 8, value.data());
+    }
+};
+
+// --- Sorted layers ---
+// The other way to deduplicate a layer: successors are appended as (state, counts) records, then
+// one LSD radix sort on the 27 state bits (three passes of 9 bits) and one sequential pass summing
+// equal neighbours. Every step streams through memory instead of scattering over a table.
+struct SortRecord {
+    State state;
+    Count counts[8];
+};
+
+struct SortedLayer {
+    std::vector<SortRecord> records;
+    std::vector<SortRecord> scratch;
+
+    inline void insert(const State& new_state, const CountArray& value) {
+        records.emplace_back();
+        SortRecord &record = records.back();
+        record.state = new_state;
+        memcpy(record.counts, value.data(), 8 * sizeof(Count));
+    }
+
+    MULTIVERSION void sort_merge() {
+        const size_t n = records.size();
+        if (n == 0)
+            return;
+        uint32_t histogram[3][513] = {{0}};
+        for (const SortRecord &record : records)
+            for (int pass = 0; pass < 3; pass++)
+                histogram[pass][((record.state >> (pass * 9)) & 511) + 1]++;
+        scratch.resize(n);
+        for (int pass = 0; pass < 3; pass++) {
+            uint32_t *offsets = histogram[pass];
+            for (int b = 0; b < 512; b++)
+                offsets[b + 1] += offsets[b];
+            for (const SortRecord &record : records)
+                scratch[offsets[(record.state >> (pass * 9)) & 511]++] = record;
+            records.swap(scratch);
+        }
+        size_t w = 0;
+        for (size_t r = 1; r < n; r++) {
+            if (records[r].state == records[w].state)
+                add_counts(records[w].counts, records[r].counts);
+            else
+                records[++w] = records[r];
+        }
+        records.resize(w + 1);
+    }
+
+    inline void clear() { records.clear(); }
+};
+
+// Owner shard of a canonical state in the parallel layers and spill partitions.
+inline int get_shard(const State state, const int shard_count) {
+    return int((uint64_t(state * 0x9E3779B1u) * uint64_t(shard_count)) >> 32);
+}
+
+// Aggregates every state of source, in insertion order, into destination.
+MULTIVERSION void merge_table(HashTable &destination, const HashTable &source) {
+    for (uint32_t i = 0; i < source.count; i++) {
+        const uint64_t pair = source.table[source.keys[i]];
+        const State state = pair & 0xFFFFFFFF;
+        const uint32_t index = (pair >> 32) & 0xFFFFFFFF;
+        CountArray counts;
+        memcpy(counts.data(), source.storage + index, 8 * sizeof(Count));
+        destination.insert(state, counts);
+    }
+}
+
+MULTIVERSION void merge_records(HashTable &destination, const SortRecord *records, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        CountArray counts;
+        memcpy(counts.data(), records[i].counts, 8 * sizeof(Count));
+        destination.insert(records[i].state, counts);
+    }
+}
+
+// --- Spilled layers ---
+// For layers that do not fit in memory: successors are appended, as SortRecords, to one file per
+// partition of the state hash through small write buffers. Partition p of a layer holds every copy
+// of its states, so it is aggregated alone (mmap + one HashTable) and expanded before the next one
+// is mapped. Resident memory is the table of the largest partition plus the write buffers.
+struct SpillWriter {
+    static constexpr size_t BUFFER_RECORDS = 4096;
+
+    std::vector<FILE *> files;
+    std::vector<std::vector<SortRecord>> buffers;
+    uint64_t records_written = 0;
+
+    inline void insert(const State& new_state, const CountArray& value) {
+        const int partition = get_shard(new_state, int(files.size()));
+        std::vector<SortRecord> &buffer = buffers[partition];
+        buffer.emplace_back();
+        buffer.back().state = new_state;
+        memcpy(buffer.back().counts, value.data(), 8 * sizeof(Count));
+        if (buffer.size() == BUFFER_RECORDS)
+            flush(partition);
+    }
+
+    void flush(const int partition) {
+        std::vector<SortRecord> &buffer = buffers[partition];
+        if (fwrite(buffer.data(), sizeof(SortRecord), buffer.size(), files[partition]) != buffer.size()) {
+            perror("spill write");
+            exit(1);
+        }
+        records_written += buffer.size();
+        buffer.clear();
+    }
+
+    void open(const std::vector<std::string> &paths) {
+        files.resize(paths.size());
+        buffers.resize(paths.size());
+        for (size_t p = 0; p < paths.size(); p++) {
+            files[p] = fopen(paths[p].c_str(), "wb");
+            if (!files[p]) {
+                perror(paths[p].c_str());
+                exit(1);
+            }
+            buffers[p].reserve(BUFFER_RECORDS);
+        }
+    }
+
+    void close() {
+        for (size_t p = 0; p < files.size(); p++) {
+            flush(int(p));
+            if (fclose(files[p]) != 0) {
+                perror("spill close");
+                exit(1);
+            }
+        }
+        files.clear();
+    }
+};
+
+// --- Search context ---
+// Everything written while expanding a layer: the table receiving the successors and the
+// final_sum accumulator. The single-threaded run uses one context, the parallel run one per worker.
+// dense_next, sorted_next or spill_next, when set, replaces next as the destination of the successors,
+// and so does shards, which sends each one to shards[get_shard(state, shard_count)].
+// The successors of the state being expanded are buffered in moves and canonicalized together.
+// 9 empty cells times 11 capture subsets bounds them, rounded up to the batch width.
+constexpr int MAX_MOVES = 104;
+
+struct SearchContext {
+    HashTable *next = nullptr;
+    uint32_t final_sum = 0;
+    DenseLayer *dense_next = nullptr;
+    SortedLayer *sorted_next = nullptr;
+    SpillWriter *spill_next = nullptr;
+    HashTable *const *shards = nullptr;
+    int shard_count = 0;
+    uint64_t final_states = 0;
+    int move_count = 0;
+    State moves[MAX_MOVES];
+    State canonical[MAX_MOVES];
+    uint32_t sym_index[MAX_MOVES];
+};
+
 // --- Global Variables ---
 int max_depth;
 int current_depth;
 HashTable states_to_process;
 HashTable new_states_to_process;
 uint32_t final_sum = 0;
+ProbeStats probe_stats;
 
-// --- Symmetry Functions using caching via compute_symmetries ---
-// Instead of calling get_symmetric_state repeatedly, we compute and cache all 8 symmetric forms at once.
-inline void add_final_state(const State new_state, const CountArray &counts) {
+inline bool is_board_full(const State state) {
+    return (state & MASK_0) && (state & MASK_1) && (state & MASK_2) &&
+           (state & MASK_3) && (state & MASK_4) && (state & MASK_5) &&
+           (state & MASK_6) && (state & MASK_7) && (state & MASK_8);
+}
+
+// --- Terminal scoring ---
+// The final hash reads the nine dice as a decimal number, die 0 first. A row is 9 contiguous bits,
+// so one 512-entry table per row gives its three digits already scaled to their place in the hash.
+struct FinalRowTable {
+    uint32_t value[3][512];
+};
+
+constexpr FinalRowTable build_final_row_table() {
+    FinalRowTable t{};
+    const uint32_t scale[3] = {1000000, 1000, 1};
+    for (int r = 0; r < 3; r++)
+        for (uint32_t bits = 0; bits < 512; bits++)
+            t.value[r][bits] = scale[r] * ((bits & 0b111) * 100 + ((bits >> 3) & 0b111) * 10 + (bits >> 6));
+    return t;
+}
+
+constexpr FinalRowTable final_rows = build_final_row_table();
+
+inline uint32_t final_hash(const State state) {
+    return final_rows.value[0][state & 0x1FF] + final_rows.value[1][(state >> 9) & 0x1FF] + final_rows.value[2][state >> 18];
+}
+
+// Final hash of each of the eight symmetric forms of a terminal state.
+inline void get_final_hashes(const State state, uint32_t hashes[8]) {
     State sym[8];
-    compute_symmetries(new_state, sym);
-    for (int i = 0; i < 8; i++) {
-        if (counts[i] == 0)
-            continue;
-        int hash = 0;
-        for (int j = 0; j < 9; j++) {
-            hash = hash * 10 + GET_DIE_VALUE(sym[i], j);
-        }
-        final_sum += hash * counts[i];
-    }
+    compute_symmetries(state, sym);
+    for (int i = 0; i < 8; i++)
+        hashes[i] = final_hash(sym[i]);
 }
 
-void insert_possible_move(const State new_state, const Count *const counts) {
+// sum[i] += final hash of the i-th symmetric form of state
+inline void add_final_hashes(const State state, LaneVector &sum) {
     State sym[8];
-    compute_symmetries(new_state, sym);
-    State canonical_state = sym[0];
-    int canonical_index = 0;
-    for (int i = 1; i < 8; i++) {
-        if (sym[i] < canonical_state) {
-            canonical_state = sym[i];
-            canonical_index = i;
-        }
-    }
-    CountArray new_counts;
-    for (int i = 0; i < 8; i++) {
-        new_counts[i] = counts[symmetric_mult[canonical_index * 8 + i]];
-    }
-    if ((current_depth == max_depth - 1) ||
-        ((canonical_state & MASK_0) && (canonical_state & MASK_1) && (canonical_state & MASK_2) &&
-         (canonical_state & MASK_3) && (canonical_state & MASK_4) && (canonical_state & MASK_5) &&
-         (canonical_state & MASK_6) && (canonical_state & MASK_7) && (canonical_state & MASK_8))) {
-        add_final_state(canonical_state, new_counts);
+    compute_symmetries(state, sym);
+    const LaneVector hashes = {final_hash(sym[0]), final_hash(sym[1]), final_hash(sym[2]), final_hash(sym[3]),
+                               final_hash(sym[4]), final_hash(sym[5]), final_hash(sym[6]), final_hash(sym[7])};
+    sum += hashes;
+}
+
+// Folds n terminal successors of one parent at once. Their hashes are summed in the raw orientation,
+// which is the parent's, so the whole batch is weighted by the parent's counts with a single dot
+// product instead of a remap and a weighting per successor.
+inline void add_final_states(SearchContext &ctx, const LaneVector &hashes, const Count *const counts, const int n) {
+    alignas(32) uint32_t lanes[8];
+    memcpy(lanes, &hashes, sizeof(lanes));
+    ctx.final_sum += weight_counts(lanes, counts);
+    ctx.final_states += n;
+}
+
+inline void insert_possible_move(SearchContext &ctx, const State new_state) {
+    ctx.moves[ctx.move_count++] = new_state;
+}
+
+// Canonicalizes the buffered successors in one batch, then folds each one into the next layer with
+// its counts remapped to the canonical orientation. Terminal successors are batched into
+// add_final_states; at the depth limit all of them are, and canonicalization is skipped.
+inline void flush_possible_moves(SearchContext &ctx, const Count *const counts) {
+    const int n = ctx.move_count;
+    ctx.move_count = 0;
+    LaneVector final_hashes = {};
+    int final_count = 0;
+    if (current_depth == max_depth - 1) {
+        for (int k = 0; k < n; k++)
+            add_final_hashes(ctx.moves[k], final_hashes);
+        final_count = n;
     } else {
-        new_states_to_process.insert(canonical_state, new_counts);
+        canonicalize_batch(ctx.moves, n, ctx.canonical, ctx.sym_index);
+        for (int k = 0; k < n; k++) {
+            const State canonical_state = ctx.canonical[k];
+            if (is_board_full(canonical_state)) {
+                add_final_hashes(ctx.moves[k], final_hashes);
+                final_count++;
+                continue;
+            }
+            const int canonical_index = ctx.sym_index[k];
+            CountArray new_counts;
+            remap_counts(new_counts.data(), counts, symmetric_mult.data() + canonical_index * 8);
+            if (ctx.dense_next)
+                ctx.dense_next->insert(canonical_state, new_counts);
+            else if (ctx.sorted_next)
+                ctx.sorted_next->insert(canonical_state, new_counts);
+            else if (ctx.spill_next)
+                ctx.spill_next->insert(canonical_state, new_counts);
+            else if (ctx.shards)
+                ctx.shards[get_shard(canonical_state, ctx.shard_count)]->insert(canonical_state, new_counts);
+            else
+                ctx.next->insert(canonical_state, new_counts);
+        }
     }
+    if (final_count)
+        add_final_states(ctx, final_hashes, counts, final_count);
 }
 
-// --- get_possible_moves (unchanged from original) ---
-State get_neighbor_mask(const State state, const int position) {
+// --- get_possible_moves_classic (unchanged from original) ---
+inline State get_neighbor_mask(const State state, const int position) {
     const State mask = state & neighbors_mask[position];
     return ( (!!(mask & 0b111)) |
              ((!!((mask >> 3) & 0b111)) << 1) |
@@ -230,7 +809,7 @@ State get_neighbor_mask(const State state, const int position) {
              ((!!((mask >> 24) & 0b111)) << 8) );
 }
 
-void get_possible_moves(const State state, const Count *const counts) {
+__attribute__((always_inline)) inline void get_possible_moves_classic(SearchContext &ctx, const State state) {
     for (int i = 0; i < 9; i++) {
         if (!IS_POSITION_EMPTY(state, i))
             continue;
@@ -246,7 +825,7 @@ void get_possible_moves(const State state, const Count *const counts) {
                 State new_state = CLEAR_DIE_VALUE(state, i0); \
                 new_state = CLEAR_DIE_VALUE(new_state, i1); \
                 new_state = SET_DIE_VALUE(new_state, i, sum); \
-                insert_possible_move(new_state, counts); \
+                insert_possible_move(ctx, new_state); \
                 capture_possible = true; \
             } \
         }
@@ -259,7 +838,7 @@ void get_possible_moves(const State state, const Count *const counts) {
                 new_state = CLEAR_DIE_VALUE(new_state, i1); \
                 new_state = CLEAR_DIE_VALUE(new_state, i2); \
                 new_state = SET_DIE_VALUE(new_state, i, sum); \
-                insert_possible_move(new_state, counts); \
+                insert_possible_move(ctx, new_state); \
                 capture_possible = true; \
             } \
         }
@@ -309,43 +888,735 @@ void get_possible_moves(const State state, const Count *const counts) {
                 new_state = CLEAR_DIE_VALUE(new_state, third_neighbor_index);
                 new_state = CLEAR_DIE_VALUE(new_state, fourth_neighbor_index);
                 new_state = SET_DIE_VALUE(new_state, i, sum);
-                insert_possible_move(new_state, counts);
+                insert_possible_move(ctx, new_state);
                 capture_possible = true;
             }
         }
 
         if (neighbor_count < 2 || !capture_possible) {
-            insert_possible_move(SET_DIE_VALUE(state, i, 1), counts);
+            insert_possible_move(ctx, SET_DIE_VALUE(state, i, 1));
         }
     }
 }
 
-int compute_final_sum() {
-    return final_sum % MOD;
+// --- Table-driven move generation ---
+// For every empty cell and every pattern of occupied orthogonal neighbours, the table lists all the
+// capture subsets (2, 3 or 4 neighbours) as a clear mask plus the shifts of the captured dice.
+// Unused shifts point to bit 27, which is always zero, so the sum is four unconditional adds.
+struct Capture {
+    State clear_mask;
+    uint8_t shift[4];
+};
+
+struct MoveTable {
+    uint8_t neighbor_count[9];
+    uint8_t neighbor[9][4];
+    uint8_t begin[9][16];
+    uint8_t size[9][16];
+    Capture captures[65];
+};
+
+constexpr MoveTable build_move_table() {
+    MoveTable t{};
+    int count = 0;
+    for (int i = 0; i < 9; i++) {
+        const int row = i / 3, col = i % 3;
+        int n = 0;
+        if (row > 0) t.neighbor[i][n++] = i - 3;
+        if (col > 0) t.neighbor[i][n++] = i - 1;
+        if (col < 2) t.neighbor[i][n++] = i + 1;
+        if (row < 2) t.neighbor[i][n++] = i + 3;
+        t.neighbor_count[i] = n;
+        for (int pattern = 0; pattern < (1 << n); pattern++) {
+            t.begin[i][pattern] = count;
+            for (int size = 2; size <= 4; size++) {
+                for (int subset = 0; subset < 16; subset++) {
+                    if ((subset & pattern) != subset || __builtin_popcount(subset) != size)
+                        continue;
+                    Capture capture{0, {27, 27, 27, 27}};
+                    int k = 0;
+                    for (int b = 0; b < n; b++) {
+                        if (!(subset & (1 << b)))
+                            continue;
+                        capture.clear_mask |= State(0b111) << (t.neighbor[i][b] * 3);
+                        capture.shift[k++] = t.neighbor[i][b] * 3;
+                    }
+                    t.captures[count++] = capture;
+                }
+            }
+            t.size[i][pattern] = count - t.begin[i][pattern];
+        }
+    }
+    return t;
 }
 
-int main() {
-    std::ios::sync_with_stdio(false);
-    std::cin.tie(nullptr);
+constexpr MoveTable move_table = build_move_table();
 
-    std::cin >> max_depth; std::cin.ignore();
-    
-    State initial_state = 0;
+__attribute__((always_inline)) inline void get_possible_moves_table(SearchContext &ctx, const State state) {
     for (int i = 0; i < 9; i++) {
-        State value;
-        std::cin >> value; std::cin.ignore();
-        initial_state = SET_DIE_VALUE(initial_state, i, value);
+        if (!IS_POSITION_EMPTY(state, i))
+            continue;
+
+        int pattern = 0;
+        for (int k = 0; k < move_table.neighbor_count[i]; k++)
+            pattern |= int(GET_DIE_VALUE(state, move_table.neighbor[i][k]) != 0) << k;
+
+        bool capture_possible = false;
+        const Capture *capture = move_table.captures + move_table.begin[i][pattern];
+        const Capture *const end = capture + move_table.size[i][pattern];
+        for (; capture != end; capture++) {
+            const State sum = ((state >> capture->shift[0]) & 0b111) + ((state >> capture->shift[1]) & 0b111) +
+                              ((state >> capture->shift[2]) & 0b111) + ((state >> capture->shift[3]) & 0b111);
+            if (sum <= 6) {
+                insert_possible_move(ctx, SET_DIE_VALUE(state & ~capture->clear_mask, i, sum));
+                capture_possible = true;
+            }
+        }
+
+        if (!capture_possible) {
+            insert_possible_move(ctx, SET_DIE_VALUE(state, i, 1));
+        }
     }
+}
 
-    CountArray initial_counts;
-    bzero(initial_counts.data(), 8 * sizeof(Count));
-    initial_counts[0] = 1;
+// Selected with --movegen classic|table, the table generator is the default.
+bool use_move_table = true;
+
+// Fills ctx.moves with the raw (not canonical) successors of state.
+inline void generate_moves(SearchContext &ctx, const State state) {
+    if (use_move_table)
+        get_possible_moves_table(ctx, state);
+    else
+        get_possible_moves_classic(ctx, state);
+}
+
+// Expansion entry point of every engine: generation, canonicalization and the layer insert are
+// inlined here, so each CPU level gets its own copy of the whole inner loop.
+MULTIVERSION void get_possible_moves(SearchContext &ctx, const State state, const Count *const counts) {
+    generate_moves(ctx, state);
+    flush_possible_moves(ctx, counts);
+}
+
+// --- Memoized solver ---
+// F(s, d) = sum of the final hashes over every game of at most d moves from board s, which is what
+// the layer sweep adds to final_sum. The table stores, for a canonical state c and d moves left, the
+// vector G(c, d)[k] = F(T_k(c), d) where T_k is the k-th transform of compute_symmetries. Moves
+// commute with the transforms, so a successor t of c with canonical form T_j(t) contributes
+// G(T_j(t), d - 1)[m] (or the final hash of T_m(T_j(t))) to G(c, d)[k], m = T_k o T_j^-1.
+// The cost is one expansion per distinct (canonical state, depth left) instead of per layer entry.
+// Value is the G vector; a board uses the low BOARD_BITS of the key and the depth left the rest.
+template <typename Value, int BOARD_BITS = 32>
+struct MemoTable {
+    static constexpr uint32_t INITIAL_CAPACITY = 1 << 16;
+
+    uint32_t capacity = 0;
+    size_t count = 0;
+    uint64_t *keys = nullptr;
+    Value *values = nullptr;
+
+    MemoTable() { allocate(INITIAL_CAPACITY); }
+
+    ~MemoTable() {
+        delete[] keys;
+        delete[] values;
+    }
+
+    MemoTable(const MemoTable&) = delete;
+    MemoTable& operator=(const MemoTable&) = delete;
+
+    void allocate(uint32_t new_capacity) {
+        capacity = new_capacity;
+        keys = new uint64_t[capacity];
+        values = new Value[capacity];
+        memset(keys, 0, capacity * sizeof(uint64_t));
+    }
+
+    // Keys are never 0: the depth left is at least 1.
+    static inline uint64_t make_key(const uint64_t board, const int depth_left) {
+        return board | (uint64_t(depth_left) << BOARD_BITS);
+    }
+
+    inline uint32_t find_slot(const uint64_t key) const {
+        uint32_t slot = hash_state(State(key) ^ State(key >> 32) * 0x9E3779B1u) & (capacity - 1);
+        while (keys[slot] != 0 && keys[slot] != key)
+            slot = (slot + 1) & (capacity - 1);
+        return slot;
+    }
+
+    inline const Value *find(const uint64_t key) const {
+        const uint32_t slot = find_slot(key);
+        return keys[slot] ? &values[slot] : nullptr;
+    }
+
+    void insert(const uint64_t key, const Value &value) {
+        if ((count + 1) * 4 > size_t(capacity) * 3) {
+            uint64_t *old_keys = keys;
+            Value *old_values = values;
+            const uint32_t old_capacity = capacity;
+            allocate(capacity * 2);
+            for (uint32_t i = 0; i < old_capacity; i++) {
+                if (!old_keys[i])
+                    continue;
+                const uint32_t slot = find_slot(old_keys[i]);
+                keys[slot] = old_keys[i];
+                values[slot] = old_values[i];
+            }
+            delete[] old_keys;
+            delete[] old_values;
+        }
+        const uint32_t slot = find_slot(key);
+        keys[slot] = key;
+        values[slot] = value;
+        count++;
+    }
+
+    void clear() {
+        memset(keys, 0, capacity * sizeof(uint64_t));
+        count = 0;
+    }
+};
+
+MemoTable<CountArray> memo_table;
+// memo_lanes[j] is the remap row for a successor whose canonical index is j: lane k reads m = T_k o T_j^-1.
+alignas(32) uint32_t memo_lanes[8][8];
+int memo_inverse[8];
+
+// Derives the group structure of the eight transforms from compute_symmetries itself.
+void init_memo_lanes() {
+    int destination[8][9];
+    for (int p = 0; p < 9; p++) {
+        State sym[8];
+        compute_symmetries(SET_DIE_VALUE(State(0), p, State(1)), sym);
+        for (int k = 0; k < 8; k++)
+            for (int q = 0; q < 9; q++)
+                if (GET_DIE_VALUE(sym[k], q))
+                    destination[k][p] = q;
+    }
+    int compose[8][8];
+    for (int a = 0; a < 8; a++) {
+        for (int b = 0; b < 8; b++) {
+            for (int k = 0; k < 8; k++) {
+                bool same = true;
+                for (int p = 0; p < 9; p++)
+                    same &= destination[k][p] == destination[a][destination[b][p]];
+                if (same)
+                    compose[a][b] = k;
+            }
+        }
+    }
+    for (int j = 0; j < 8; j++)
+        for (int k = 0; k < 8; k++)
+            if (compose[k][j] == 0)
+                memo_inverse[j] = k;
+    for (int j = 0; j < 8; j++)
+        for (int k = 0; k < 8; k++)
+            memo_lanes[j][k] = compose[k][memo_inverse[j]];
+}
+
+MULTIVERSION CountArray solve_memo(const State canonical_state, const int depth_left) {
+    const uint64_t key = MemoTable<CountArray>::make_key(canonical_state, depth_left);
+    if (const CountArray *known = memo_table.find(key))
+        return *known;
+
+    SearchContext ctx;
+    generate_moves(ctx, canonical_state);
+    const int n = ctx.move_count;
+    canonicalize_batch(ctx.moves, n, ctx.canonical, ctx.sym_index);
+
+    CountArray result{};
+    for (int k = 0; k < n; k++) {
+        CountArray child;
+        if (depth_left == 1 || is_board_full(ctx.canonical[k]))
+            get_final_hashes(ctx.canonical[k], child.data());
+        else
+            child = solve_memo(ctx.canonical[k], depth_left - 1);
+        CountArray remapped;
+        remap_counts(remapped.data(), child.data(), memo_lanes[ctx.sym_index[k]]);
+        add_counts(result.data(), remapped.data());
+    }
+    memo_table.insert(key, result);
+    return result;
+}
+
+uint32_t run_memo(const State initial_state) {
+    if (max_depth <= 0)
+        return 0;
+    State canonical;
+    uint32_t canonical_index;
+    alignas(32) State padded[8] = {initial_state};
+    canonicalize_batch(padded, 1, &canonical, &canonical_index);
+    const CountArray values = solve_memo(canonical, max_depth);
+    return values[memo_inverse[canonical_index]];
+}
+
+// --- Compile-time board variants ---
+// The 3x3 kernels above are hand-written for 3-bit dice capped at 6. BoardVariant generates the same
+// game for WIDTH x HEIGHT cells of BITS bits each, dice capped at CAP: cell masks, neighbour lists,
+// decimal place values and the symmetry group (the 8 transforms of a square, the 4 flips of a
+// rectangle) with its composition table are constexpr, so every loop over cells or transforms has a
+// constant trip count and unrolls. It is solved with the memoized search of solve_memo.
+template <int WIDTH, int HEIGHT, int CAP, int BITS>
+struct BoardVariant {
+    static constexpr int CELLS = WIDTH * HEIGHT;
+    static constexpr int BOARD_BITS = CELLS * BITS;
+    static constexpr int SYMMETRIES = WIDTH == HEIGHT ? 8 : 4;
+    static constexpr int MAX_VARIANT_MOVES = CELLS * 11;
+    static_assert(BOARD_BITS <= 56, "the board and the depth left must share a 64-bit memo key");
+    static_assert(CAP >= 2 && CAP < (1 << BITS), "CAP must fit in BITS bits");
+
+    typedef typename std::conditional<BOARD_BITS <= 32, uint32_t, uint64_t>::type Board;
+    typedef std::array<uint32_t, SYMMETRIES> Values;
+
+    struct Tables {
+        Board cell_mask[CELLS];
+        int neighbor[CELLS][4];
+        int neighbor_count[CELLS];
+        // T_k moves the die of cell c to cell transform[k][c]; T_compose[a][b] = T_a o T_b.
+        int transform[SYMMETRIES][CELLS];
+        int compose[SYMMETRIES][SYMMETRIES];
+        int inverse[SYMMETRIES];
+        // 10^(CELLS - 1 - c) mod 2^32: the final hash reads cell 0 first.
+        uint32_t place_value[CELLS];
+    };
+
+    static constexpr Tables build_tables() {
+        Tables t{};
+        uint32_t place = 1;
+        for (int c = CELLS - 1; c >= 0; c--) {
+            t.place_value[c] = place;
+            place *= 10;
+        }
+        for (int c = 0; c < CELLS; c++) {
+            const int x = c % WIDTH, y = c / WIDTH;
+            t.cell_mask[c] = Board((1u << BITS) - 1) << (c * BITS);
+            // Same neighbour order as neighbors_mask: up, left, right, down.
+            const int dx[4] = {0, -1, 1, 0}, dy[4] = {-1, 0, 0, 1};
+            for (int d = 0; d < 4; d++) {
+                const int nx = x + dx[d], ny = y + dy[d];
+                if (nx >= 0 && nx < WIDTH && ny >= 0 && ny < HEIGHT)
+                    t.neighbor[c][t.neighbor_count[c]++] = ny * WIDTH + nx;
+            }
+            // bit 0 flips the rows, bit 1 the columns, bit 2 transposes (square boards only).
+            for (int k = 0; k < SYMMETRIES; k++) {
+                int tx = (k & 2) ? WIDTH - 1 - x : x;
+                int ty = (k & 1) ? HEIGHT - 1 - y : y;
+                if (k & 4) {
+                    const int swap = tx;
+                    tx = ty;
+                    ty = swap;
+                }
+                t.transform[k][c] = ty * WIDTH + tx;
+            }
+        }
+        for (int a = 0; a < SYMMETRIES; a++) {
+            for (int b = 0; b < SYMMETRIES; b++) {
+                for (int k = 0; k < SYMMETRIES; k++) {
+                    bool same = true;
+                    for (int c = 0; c < CELLS; c++)
+                        same = same && t.transform[k][c] == t.transform[a][t.transform[b][c]];
+                    if (same)
+                        t.compose[a][b] = k;
+                }
+            }
+        }
+        for (int j = 0; j < SYMMETRIES; j++)
+            for (int k = 0; k < SYMMETRIES; k++)
+                if (t.compose[k][j] == 0)
+                    t.inverse[j] = k;
+        return t;
+    }
+
+    static constexpr Tables tables = build_tables();
+
+    MemoTable<Values, BOARD_BITS> memo;
+
+    static inline int get(const Board board, const int c) {
+        return int((board >> (c * BITS)) & ((1u << BITS) - 1));
+    }
+
+    static inline Board apply(const Board board, const int k) {
+        Board result = 0;
+        for (int c = 0; c < CELLS; c++)
+            result |= Board(get(board, c)) << (tables.transform[k][c] * BITS);
+        return result;
+    }
+
+    static inline Board canonicalize(const Board board, int &index) {
+        Board best = board;
+        index = 0;
+        for (int k = 1; k < SYMMETRIES; k++) {
+            const Board candidate = apply(board, k);
+            if (candidate < best) {
+                best = candidate;
+                index = k;
+            }
+        }
+        return best;
+    }
+
+    static inline bool is_full(const Board board) {
+        for (int c = 0; c < CELLS; c++)
+            if (!(board & tables.cell_mask[c]))
+                return false;
+        return true;
+    }
+
+    static inline uint32_t final_hash(const Board board) {
+        uint32_t hash = 0;
+        for (int c = 0; c < CELLS; c++)
+            hash += uint32_t(get(board, c)) * tables.place_value[c];
+        return hash;
+    }
+
+    // Same rules as get_possible_moves_table: every subset of two or more occupied neighbours summing
+    // to at most CAP is a capture, and a 1 is placed when no capture is possible.
+    static inline int generate(const Board board, Board moves[MAX_VARIANT_MOVES]) {
+        int n = 0;
+        for (int c = 0; c < CELLS; c++) {
+            if (board & tables.cell_mask[c])
+                continue;
+            int occupied[4], count = 0;
+            for (int d = 0; d < tables.neighbor_count[c]; d++)
+                if (board & tables.cell_mask[tables.neighbor[c][d]])
+                    occupied[count++] = tables.neighbor[c][d];
+            bool capture_possible = false;
+            for (int subset = 3; subset < (1 << count); subset++) {
+                if (!(subset & (subset - 1)))
+                    continue;
+                int sum = 0;
+                Board cleared = board;
+                for (int d = 0; d < count; d++) {
+                    if (subset & (1 << d)) {
+                        sum += get(board, occupied[d]);
+                        cleared &= ~tables.cell_mask[occupied[d]];
+                    }
+                }
+                if (sum <= CAP) {
+                    moves[n++] = cleared | (Board(sum) << (c * BITS));
+                    capture_possible = true;
+                }
+            }
+            if (!capture_possible)
+                moves[n++] = board | (Board(1) << (c * BITS));
+        }
+        return n;
+    }
+
+    Values solve(const Board canonical_board, const int depth_left) {
+        const uint64_t key = MemoTable<Values, BOARD_BITS>::make_key(canonical_board, depth_left);
+        if (const Values *known = memo.find(key))
+            return *known;
+
+        Board moves[MAX_VARIANT_MOVES];
+        const int n = generate(canonical_board, moves);
+        Values result{};
+        for (int i = 0; i < n; i++) {
+            int j;
+            const Board child_board = canonicalize(moves[i], j);
+            Values child;
+            if (depth_left == 1 || is_full(child_board)) {
+                for (int m = 0; m < SYMMETRIES; m++)
+                    child[m] = final_hash(apply(child_board, m));
+            } else {
+                child = solve(child_board, depth_left - 1);
+            }
+            for (int k = 0; k < SYMMETRIES; k++)
+                result[k] += child[tables.compose[k][tables.inverse[j]]];
+        }
+        memo.insert(key, result);
+        return result;
+    }
+
+    // cells holds the CELLS starting dice, cell 0 first.
+    uint32_t run(const int *cells, const int depth) {
+        if (depth <= 0)
+            return 0;
+        Board board = 0;
+        for (int c = 0; c < CELLS; c++)
+            board |= Board(cells[c]) << (c * BITS);
+        int j;
+        const Board canonical_board = canonicalize(board, j);
+        return solve(canonical_board, depth)[tables.inverse[j]];
+    }
+};
+
+// The variants compiled in, selected with --board WxH and --cap N. 3x3 with cap 6 is the puzzle
+// itself and must agree with every other solver.
+template <int WIDTH, int HEIGHT, int CAP, int BITS>
+bool run_variant_if(const int width, const int height, const int cap, const int *cells, const int depth, uint32_t &sum) {
+    if (width != WIDTH || height != HEIGHT || cap != CAP)
+        return false;
+    BoardVariant<WIDTH, HEIGHT, CAP, BITS> variant;
+    sum = variant.run(cells, depth);
+    return true;
+}
+
+bool run_variant(const int width, const int height, const int cap, const int *cells, const int depth, uint32_t &sum) {
+    return run_variant_if<3, 3, 6, 3>(width, height, cap, cells, depth, sum) ||
+           run_variant_if<3, 3, 12, 4>(width, height, cap, cells, depth, sum) ||
+           run_variant_if<2, 3, 6, 3>(width, height, cap, cells, depth, sum) ||
+           run_variant_if<3, 2, 6, 3>(width, height, cap, cells, depth, sum) ||
+           run_variant_if<3, 4, 6, 3>(width, height, cap, cells, depth, sum) ||
+           run_variant_if<4, 3, 6, 3>(width, height, cap, cells, depth, sum) ||
+           run_variant_if<4, 4, 6, 3>(width, height, cap, cells, depth, sum);
+}
+
+// --- Depth profile ---
+// What --profile and --bench record for each depth of a sweep. The probe counters are those of the
+// tables receiving the depth's successors. Their max_groups is folded into probe_stats and reset
+// when a depth begins, so the reported maximum is the depth's own.
+struct DepthProfile {
+    int depth;
+    uint64_t layer_size;
+    uint64_t final_states;
+    uint64_t next_size;
+    double load_factor;
+    ProbeStats probes;
+    double milliseconds;
+};
+
+bool collect_profile = false;
+std::vector<DepthProfile> depth_profiles;
+
+struct DepthMeter {
+    std::chrono::steady_clock::time_point start;
+    ProbeStats before;
+    uint64_t final_states_before = 0;
+
+    static ProbeStats sum(const std::vector<HashTable *> &tables) {
+        ProbeStats total;
+        for (const HashTable *table : tables)
+            total.add(table->stats);
+        return total;
+    }
+
+    void begin(const std::vector<HashTable *> &tables, const uint64_t final_states) {
+        if (!collect_profile)
+            return;
+        for (HashTable *table : tables) {
+            probe_stats.max_groups = std::max(probe_stats.max_groups, table->stats.max_groups);
+            table->stats.max_groups = 0;
+        }
+        before = sum(tables);
+        final_states_before = final_states;
+        start = std::chrono::steady_clock::now();
+    }
+
+    void end(const int depth, const uint64_t layer_size, const std::vector<HashTable *> &tables,
+             const uint64_t final_states, const uint64_t next_size, const double load_factor) {
+        if (!collect_profile)
+            return;
+        const ProbeStats after = sum(tables);
+        DepthProfile profile;
+        profile.depth = depth;
+        profile.layer_size = layer_size;
+        profile.final_states = final_states - final_states_before;
+        profile.next_size = next_size;
+        profile.load_factor = load_factor;
+        profile.probes.lookups = after.lookups - before.lookups;
+        profile.probes.groups = after.groups - before.groups;
+        profile.probes.max_groups = after.max_groups;
+        profile.probes.rehashes = after.rehashes - before.rehashes;
+        profile.probes.storage_growths = after.storage_growths - before.storage_growths;
+        profile.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        depth_profiles.push_back(profile);
+    }
+};
+
+// One JSON object per line.
+void print_depth_profile(std::ostream &out, const DepthProfile &profile) {
+    out << "{\"depth\":" << profile.depth
+        << ",\"layer_size\":" << profile.layer_size
+        << ",\"final_states\":" << profile.final_states
+        << ",\"next_size\":" << profile.next_size
+        << ",\"load_factor\":" << profile.load_factor
+        << ",\"lookups\":" << profile.probes.lookups
+        << ",\"avg_probe\":" << (profile.probes.lookups ? double(profile.probes.groups) / profile.probes.lookups : 0.0)
+        << ",\"max_probe\":" << profile.probes.max_groups
+        << ",\"rehashes\":" << profile.probes.rehashes
+        << ",\"storage_growths\":" << profile.probes.storage_growths
+        << ",\"ms\":" << profile.milliseconds << "}\n";
+}
+
+// --- Parallel layer expansion ---
+// A fixed set of workers; run() executes job(0..size-1) and returns once all of them are done.
+// Job 0 runs on the calling thread.
+struct WorkerPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    std::function<void(int)> job;
+    uint64_t generation = 0;
+    int pending = 0;
+    bool stop = false;
+
+    explicit WorkerPool(int size) {
+        for (int t = 1; t < size; t++) {
+            threads.emplace_back([this, t] {
+                uint64_t seen = 0;
+                for (;;) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    start_cv.wait(lock, [&] { return stop || generation != seen; });
+                    if (stop)
+                        return;
+                    seen = generation;
+                    lock.unlock();
+                    job(t);
+                    lock.lock();
+                    if (--pending == 0)
+                        done_cv.notify_one();
+                }
+            });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        start_cv.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    int size() const { return int(threads.size()) + 1; }
+
+    void run(const std::function<void(int)> &new_job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = new_job;
+            pending = int(threads.size());
+            generation++;
+        }
+        start_cv.notify_all();
+        job(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [&] { return pending == 0; });
+    }
+};
+
+// Each layer is split in one HashTable shard per worker.
+// Expansion: worker t walks its slice of the layer (shards concatenated in order) into its own
+// final_sum and its own row of local tables, one per destination shard. Merge: worker s builds
+// shard s of the next layer from column s of the local tables in worker order, so every local entry
+// is read once. Insertion order therefore only depends on the worker count, and since counts and
+// final_sum are sums modulo 2^32 the answer is bit-identical to the single-threaded run.
+// The pool and the tables outlive a query, so batch runs only pay for them once. The n * n local
+// tables start at 1/n of the usual capacity, which keeps their total where the n rows were.
+struct ParallelSearch {
+    WorkerPool pool;
+    const int n;
+    std::vector<HashTable> layer_a, layer_b;
+    std::deque<HashTable> local_tables;
+    std::vector<HashTable *> local;   // local[t * n + s]: successors of worker t owned by shard s
+    std::vector<SearchContext> contexts;
+
+    explicit ParallelSearch(const int thread_count)
+        : pool(thread_count), n(pool.size()), layer_a(n), layer_b(n), contexts(n) {
+        uint32_t capacity = HashTable::INITIAL_CAPACITY;
+        while (capacity > 16 * HashTable::GROUP_SIZE && capacity * uint32_t(n) > HashTable::INITIAL_CAPACITY)
+            capacity /= 2;
+        for (int i = 0; i < n * n; i++)
+            local.push_back(&local_tables.emplace_back(capacity));
+    }
+
+    uint32_t run(const State initial_state, const CountArray &initial_counts) {
+        for (int t = 0; t < n; t++) {
+            contexts[t] = SearchContext{};
+            contexts[t].shards = &local[t * n];
+            contexts[t].shard_count = n;
+        }
+
+        HashTable *current = layer_a.data();
+        HashTable *next = layer_b.data();
+        current[get_shard(initial_state, n)].insert(initial_state, initial_counts);
+        DepthMeter meter;
+
+        for (current_depth = 0; current_depth < max_depth; current_depth++) {
+            std::vector<uint32_t> offsets(n + 1, 0);
+            for (int s = 0; s < n; s++)
+                offsets[s + 1] = offsets[s] + current[s].count;
+            const uint32_t layer_size = offsets[n];
+            if (layer_size == 0)
+                break;
+            std::vector<HashTable *> meter_tables = local;
+            for (int s = 0; s < n; s++)
+                meter_tables.push_back(&next[s]);
+            meter.begin(meter_tables, final_states());
+
+            pool.run([&](int t) {
+                const uint32_t begin = uint32_t(uint64_t(layer_size) * t / n);
+                const uint32_t end = uint32_t(uint64_t(layer_size) * (t + 1) / n);
+                int s = int(std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin()) - 1;
+                for (uint32_t g = begin; g < end; g++) {
+                    while (g >= offsets[s + 1])
+                        s++;
+                    const HashTable &shard = current[s];
+                    const uint64_t pair = shard.table[shard.keys[g - offsets[s]]];
+                    const State state = pair & 0xFFFFFFFF;
+                    const uint32_t index = (pair >> 32) & 0xFFFFFFFF;
+                    get_possible_moves(contexts[t], state, shard.storage + index);
+                }
+            });
+
+            pool.run([&](int s) {
+                HashTable &shard = next[s];
+                for (int t = 0; t < n; t++) {
+                    merge_table(shard, *local[t * n + s]);
+                    local[t * n + s]->clear();
+                }
+                current[s].clear();
+            });
+
+            if (collect_profile) {
+                uint64_t next_size = 0, capacity = 0;
+                for (int s = 0; s < n; s++) {
+                    next_size += next[s].count;
+                    capacity += next[s].capacity;
+                }
+                meter.end(current_depth, layer_size, meter_tables, final_states(), next_size, double(next_size) / capacity);
+            }
+            std::swap(current, next);
+        }
+
+        uint32_t sum = 0;
+        for (int t = 0; t < n; t++) {
+            sum += contexts[t].final_sum;
+            current[t].clear();
+        }
+        return sum;
+    }
+
+    uint64_t final_states() const {
+        uint64_t total = 0;
+        for (int t = 0; t < n; t++)
+            total += contexts[t].final_states;
+        return total;
+    }
+
+    void collect_stats(ProbeStats &stats) const {
+        for (int t = 0; t < n; t++) {
+            stats.add(layer_a[t].stats);
+            stats.add(layer_b[t].stats);
+        }
+        for (const HashTable *table : local)
+            stats.add(table->stats);
+    }
+};
+
+uint32_t run_layers(const State initial_state, const CountArray &initial_counts) {
     states_to_process.insert(initial_state, initial_counts);
+    SearchContext ctx;
+    ctx.next = &new_states_to_process;
+    const std::vector<HashTable *> meter_tables = {&new_states_to_process};
+    DepthMeter meter;
 
-    int iteration = 0;
     for (current_depth = 0; current_depth < max_depth; current_depth++) {
         if (states_to_process.count == 0)
             break;
+        meter.begin(meter_tables, ctx.final_states);
         
         for (uint32_t i = 0; i < states_to_process.count; i++) {
             const uint32_t table_index = states_to_process.keys[i];
@@ -354,13 +1625,620 @@ int main() {
             const uint32_t index = (pair >> 32) & 0xFFFFFFFF;
             const Count * const counts = states_to_process.storage + index;
             
-            get_possible_moves(state, counts);
-            iteration++;
+            get_possible_moves(ctx, state, counts);
         }
 
+        meter.end(current_depth, states_to_process.count, meter_tables, ctx.final_states, new_states_to_process.count,
+                  double(new_states_to_process.count) / new_states_to_process.capacity);
         swap_hash_table(states_to_process, new_states_to_process);
         new_states_to_process.clear();
     }
+    states_to_process.clear();
+
+    return ctx.final_sum;
+}
+
+// Same sweep as run_layers over two DenseLayers: the live states of a layer are the set bits of
+// its occupancy bitmap, visited in rank order. Only canonical states have a rank, so the initial
+// board goes in canonical form with its counts remapped like any successor.
+struct DenseSearch {
+    DenseLayer layer_a, layer_b;
+
+    explicit DenseSearch(const StateRanking &ranking) : layer_a(ranking), layer_b(ranking) {}
+
+    uint32_t run(const State initial_state, const CountArray &initial_counts) {
+        DenseLayer *current = &layer_a;
+        DenseLayer *next = &layer_b;
+        alignas(32) State padded[8] = {initial_state};
+        State canonical;
+        uint32_t canonical_index;
+        canonicalize_batch(padded, 1, &canonical, &canonical_index);
+        CountArray counts;
+        remap_counts(counts.data(), initial_counts.data(), symmetric_mult.data() + canonical_index * 8);
+        current->insert(canonical, counts);
+        SearchContext ctx;
+        ctx.dense_next = next;
+
+        DepthMeter meter;
+        for (current_depth = 0; current_depth < max_depth && current->count; current_depth++) {
+            meter.begin({}, ctx.final_states);
+            const uint64_t layer_size = current->count;
+            for (uint32_t w = 0; w < current->word_count; w++) {
+                for (uint64_t bits = current->occupied[w]; bits; bits &= bits - 1) {
+                    const uint32_t rank = w * 64 + __builtin_ctzll(bits);
+                    Count *const counts = current->counts + size_t(rank) * 8;
+                    get_possible_moves(ctx, current->ranking->canonical_states[rank], counts);
+                    memset(counts, 0, 8 * sizeof(Count));
+                }
+                current->occupied[w] = 0;
+            }
+            meter.end(current_depth, layer_size, {}, ctx.final_states, next->count, double(next->count) / current->ranking->size());
+            current->count = 0;
+            std::swap(current, next);
+            ctx.dense_next = next;
+        }
+        clear(*current);
+        return ctx.final_sum;
+    }
+
+    static void clear(DenseLayer &layer) {
+        for (uint32_t w = 0; w < layer.word_count; w++) {
+            for (uint64_t bits = layer.occupied[w]; bits; bits &= bits - 1)
+                memset(layer.counts + size_t(w * 64 + __builtin_ctzll(bits)) * 8, 0, 8 * sizeof(Count));
+            layer.occupied[w] = 0;
+        }
+        layer.count = 0;
+    }
+};
+
+// Sweep over SortedLayers. Workers expand contiguous slices of the sorted layer into their own
+// record buffers, which are concatenated in worker order before the sort, so any worker count
+// gives the same next layer.
+struct SortSearch {
+    WorkerPool pool;
+    const int n;
+    std::vector<SortedLayer> local;
+    std::vector<SearchContext> contexts;
+    SortedLayer layer_a, layer_b;
+
+    explicit SortSearch(const int thread_count) : pool(thread_count), n(pool.size()), local(n), contexts(n) {}
+
+    uint32_t run(const State initial_state, const CountArray &initial_counts) {
+        for (int t = 0; t < n; t++) {
+            contexts[t] = SearchContext{};
+            contexts[t].sorted_next = &local[t];
+        }
+
+        SortedLayer *current = &layer_a;
+        SortedLayer *next = &layer_b;
+        current->insert(initial_state, initial_counts);
+
+        DepthMeter meter;
+        for (current_depth = 0; current_depth < max_depth && !current->records.empty(); current_depth++) {
+            uint64_t final_states = 0;
+            for (int t = 0; t < n; t++)
+                final_states += contexts[t].final_states;
+            meter.begin({}, final_states);
+            const size_t layer_size = current->records.size();
+            pool.run([&](int t) {
+                const size_t begin = layer_size * t / n;
+                const size_t end = layer_size * (t + 1) / n;
+                for (size_t i = begin; i < end; i++)
+                    get_possible_moves(contexts[t], current->records[i].state, current->records[i].counts);
+            });
+            for (int t = 0; t < n; t++) {
+                next->records.insert(next->records.end(), local[t].records.begin(), local[t].records.end());
+                local[t].clear();
+            }
+            next->sort_merge();
+            if (collect_profile) {
+                uint64_t final_states = 0;
+                for (int t = 0; t < n; t++)
+                    final_states += contexts[t].final_states;
+                meter.end(current_depth, layer_size, {}, final_states, next->records.size(), 0.0);
+            }
+            current->clear();
+            std::swap(current, next);
+        }
+        current->clear();
+
+        uint32_t sum = 0;
+        for (int t = 0; t < n; t++)
+            sum += contexts[t].final_sum;
+        return sum;
+    }
+};
+
+// Sweep over spilled layers in DIR/layer_<depth>_<partition>.bin. After each depth, a checkpoint
+// (written to a temporary file, then renamed) records the depth reached and final_sum; the input
+// layer is only deleted once the checkpoint of the next one exists. --resume restarts from it.
+struct SpillSearch {
+    static constexpr uint32_t CHECKPOINT_MAGIC = 0x5350494C;
+
+    struct Checkpoint {
+        uint32_t magic;
+        int max_depth;
+        State initial_state;
+        int partitions;
+        int depth;
+        uint32_t final_sum;
+    };
+
+    std::string directory;
+    int partitions;
+    bool resume;
+    SpillWriter writer;
+    HashTable table;
+
+    SpillSearch(const char *dir, const int partition_count, const bool resume_run)
+        : directory(dir), partitions(partition_count), resume(resume_run) {
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            perror(directory.c_str());
+            exit(1);
+        }
+    }
+
+    std::string layer_path(const int depth, const int partition) const {
+        return directory + "/layer_" + std::to_string(depth) + "_" + std::to_string(partition) + ".bin";
+    }
+
+    std::vector<std::string> layer_paths(const int depth) const {
+        std::vector<std::string> paths;
+        for (int p = 0; p < partitions; p++)
+            paths.push_back(layer_path(depth, p));
+        return paths;
+    }
+
+    void remove_layer(const int depth) const {
+        for (int p = 0; p < partitions; p++)
+            unlink(layer_path(depth, p).c_str());
+    }
+
+    void save_checkpoint(const State initial_state, const int depth, const uint32_t sum) const {
+        const Checkpoint checkpoint{CHECKPOINT_MAGIC, max_depth, initial_state, partitions, depth, sum};
+        const std::string path = directory + "/checkpoint";
+        const std::string temporary = path + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "wb");
+        if (!file || fwrite(&checkpoint, sizeof(checkpoint), 1, file) != 1 || fclose(file) != 0) {
+            perror("checkpoint");
+            exit(1);
+        }
+        if (rename(temporary.c_str(), path.c_str()) != 0) {
+            perror("checkpoint rename");
+            exit(1);
+        }
+    }
+
+    bool load_checkpoint(const State initial_state, int &depth, uint32_t &sum) const {
+        FILE *file = fopen((directory + "/checkpoint").c_str(), "rb");
+        if (!file)
+            return false;
+        Checkpoint checkpoint;
+        const bool read = fread(&checkpoint, sizeof(checkpoint), 1, file) == 1;
+        fclose(file);
+        if (!read || checkpoint.magic != CHECKPOINT_MAGIC || checkpoint.max_depth != max_depth ||
+            checkpoint.initial_state != initial_state || checkpoint.partitions != partitions)
+            return false;
+        depth = checkpoint.depth;
+        sum = checkpoint.final_sum;
+        return true;
+    }
+
+    // Aggregates one partition file into table, then expands it. Returns the number of states.
+    // SpillWriter creates every partition file, even empty ones, so a missing one is lost data.
+    size_t expand_partition(SearchContext &ctx, const std::string &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            perror(path.c_str());
+            exit(1);
+        }
+        const size_t record_count = info.st_size / sizeof(SortRecord);
+        if (record_count == 0) {
+            ::close(fd);
+            return 0;
+        }
+        void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            perror("spill mmap");
+            exit(1);
+        }
+        madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+        merge_records(table, (const SortRecord *)mapped, record_count);
+        munmap(mapped, info.st_size);
+
+        for (uint32_t i = 0; i < table.count; i++) {
+            const uint64_t pair = table.table[table.keys[i]];
+            const State state = pair & 0xFFFFFFFF;
+            const uint32_t index = (pair >> 32) & 0xFFFFFFFF;
+            get_possible_moves(ctx, state, table.storage + index);
+        }
+        const size_t state_count = table.count;
+        table.clear();
+        return state_count;
+    }
+
+    uint32_t run(const State initial_state, const CountArray &initial_counts) {
+        int depth = 0;
+        uint32_t sum = 0;
+        if (!resume || !load_checkpoint(initial_state, depth, sum)) {
+            writer.open(layer_paths(0));
+            writer.insert(initial_state, initial_counts);
+            writer.close();
+            save_checkpoint(initial_state, 0, 0);
+        }
+
+        SearchContext ctx;
+        ctx.final_sum = sum;
+        ctx.spill_next = &writer;
+        const std::vector<HashTable *> meter_tables = {&table};
+        DepthMeter meter;
+        for (current_depth = depth; current_depth < max_depth; current_depth++) {
+            meter.begin(meter_tables, ctx.final_states);
+            const uint64_t written = writer.records_written;
+            writer.open(layer_paths(current_depth + 1));
+            size_t layer_size = 0;
+            for (int p = 0; p < partitions; p++)
+                layer_size += expand_partition(ctx, layer_path(current_depth, p));
+            writer.close();
+            meter.end(current_depth, layer_size, meter_tables, ctx.final_states, writer.records_written - written, 0.0);
+            save_checkpoint(initial_state, current_depth + 1, ctx.final_sum);
+            remove_layer(current_depth);
+            if (layer_size == 0)
+                break;
+        }
+        remove_layer(current_depth);
+        remove_layer(current_depth + 1);
+        unlink((directory + "/checkpoint").c_str());
+        return ctx.final_sum;
+    }
+};
+
+// --- Solver selection ---
+enum Engine { ENGINE_HASH, ENGINE_DENSE, ENGINE_SORT, ENGINE_SPILL };
+const char *const engine_names[] = {"hash", "dense", "sort", "spill"};
+
+int thread_count = 1;
+bool use_memo = false;
+Engine engine = ENGINE_HASH;
+const char *rank_cache = nullptr;
+ParallelSearch *parallel_search = nullptr;
+StateRanking *state_ranking = nullptr;
+DenseSearch *dense_search = nullptr;
+SortSearch *sort_search = nullptr;
+SpillSearch *spill_search = nullptr;
+const char *spill_directory = "spill";
+int spill_partitions = 16;
+bool spill_resume = false;
+
+// Creates what the selected solver needs, once per process.
+void prepare_engine() {
+    if (use_memo) {
+        init_memo_lanes();
+    } else if (engine == ENGINE_DENSE) {
+        if (dense_search)
+            return;
+        state_ranking = new StateRanking();
+        if (!rank_cache || !state_ranking->load(rank_cache)) {
+            state_ranking->build();
+            if (rank_cache)
+                state_ranking->save(rank_cache);
+        }
+        dense_search = new DenseSearch(*state_ranking);
+    } else if (engine == ENGINE_SORT) {
+        if (!sort_search)
+            sort_search = new SortSearch(thread_count);
+    } else if (engine == ENGINE_SPILL) {
+        if (!spill_search)
+            spill_search = new SpillSearch(spill_directory, spill_partitions, spill_resume);
+    } else if (thread_count > 1 && !parallel_search) {
+        parallel_search = new ParallelSearch(thread_count);
+    }
+}
+
+uint32_t solve(const State initial_state) {
+    depth_profiles.clear();
+    if (use_memo)
+        return run_memo(initial_state);
+
+    CountArray initial_counts;
+    bzero(initial_counts.data(), 8 * sizeof(Count));
+    initial_counts[0] = 1;
+
+    if (engine == ENGINE_DENSE)
+        return dense_search->run(initial_state, initial_counts);
+    if (engine == ENGINE_SORT)
+        return sort_search->run(initial_state, initial_counts);
+    if (engine == ENGINE_SPILL)
+        return spill_search->run(initial_state, initial_counts);
+    if (parallel_search)
+        return parallel_search->run(initial_state, initial_counts);
+    return run_layers(initial_state, initial_counts);
+}
+
+int compute_final_sum() {
+    return final_sum % MOD;
+}
+
+void print_probe_stats() {
+    probe_stats.add(states_to_process.stats);
+    probe_stats.add(new_states_to_process.stats);
+    if (parallel_search)
+        parallel_search->collect_stats(probe_stats);
+    if (spill_search)
+        probe_stats.add(spill_search->table.stats);
+    std::cerr << "lookups=" << probe_stats.lookups
+              << " avg_probe=" << (probe_stats.lookups ? double(probe_stats.groups) / probe_stats.lookups : 0.0)
+              << " max_probe=" << probe_stats.max_groups
+              << " rehashes=" << probe_stats.rehashes
+              << " storage_growths=" << probe_stats.storage_growths
+              << " cpu_level=" << cpu_level();
+    if (use_memo)
+        std::cerr << " memo_entries=" << memo_table.count;
+    if (state_ranking)
+        std::cerr << " canonical_states=" << state_ranking->size();
+    if (spill_search)
+        std::cerr << " spilled_records=" << spill_search->writer.records_written;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cerr << " max_rss_kb=" << usage.ru_maxrss;
+    std::cerr << std::endl;
+}
+
+bool print_profile = false;
+
+void report_profile() {
+    if (!print_profile)
+        return;
+    for (const DepthProfile &profile : depth_profiles)
+        print_depth_profile(std::cerr, profile);
+}
+
+// One record is max_depth followed by the nine dice.
+bool read_query(std::istream &in, State &initial_state) {
+    if (!(in >> max_depth))
+        return false;
+    initial_state = 0;
+    for (int i = 0; i < 9; i++) {
+        State value;
+        if (!(in >> value))
+            return false;
+        initial_state = SET_DIE_VALUE(initial_state, i, value);
+    }
+    return true;
+}
+
+// Answers every record of the stream in order. The HashTables, the worker pool and the memo table
+// (its entries do not depend on max_depth) stay warm from one query to the next.
+void run_batch(std::istream &in) {
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t queries = 0;
+    State initial_state;
+    while (read_query(in, initial_state)) {
+        final_sum = solve(initial_state);
+        std::cout << compute_final_sum() << '\n';
+        report_profile();
+        queries++;
+    }
+    std::cout.flush();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "queries=" << queries << " seconds=" << seconds
+              << " queries_per_second=" << (seconds > 0 ? queries / seconds : 0.0) << std::endl;
+}
+
+// Deep inputs for --compare-engines: max_depth followed by the nine dice.
+const int deep_corpus[][10] = {
+    {36, 6, 0, 4, 2, 0, 2, 4, 0, 0},
+    {40, 0, 0, 4, 0, 2, 4, 1, 3, 4},
+    {40, 0, 5, 4, 0, 3, 0, 0, 3, 0},
+    {50, 0, 5, 1, 0, 0, 0, 4, 0, 1},
+    {60, 0, 5, 1, 0, 0, 0, 4, 0, 1},
+};
+
+// Times the deep corpus on every layer engine and checks that the answers agree.
+void compare_engines() {
+    const Engine engines[] = {ENGINE_HASH, ENGINE_SORT, ENGINE_DENSE};
+    const int query_count = sizeof(deep_corpus) / sizeof(deep_corpus[0]);
+    std::vector<uint32_t> reference;
+    for (int e = 0; e < 3; e++) {
+        engine = engines[e];
+        prepare_engine();
+        const auto start = std::chrono::steady_clock::now();
+        bool match = true;
+        for (int q = 0; q < query_count; q++) {
+            max_depth = deep_corpus[q][0];
+            State initial_state = 0;
+            for (int i = 0; i < 9; i++)
+                initial_state = SET_DIE_VALUE(initial_state, i, State(deep_corpus[q][i + 1]));
+            const uint32_t answer = solve(initial_state) % MOD;
+            if (e == 0)
+                reference.push_back(answer);
+            match &= answer == reference[q];
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "engine=" << engine_names[engines[e]] << " queries=" << query_count << " seconds=" << seconds
+                  << " match=" << match << std::endl;
+    }
+}
+
+// Fixed corpus for --bench, from trivial to the worst case (the whole game tree of an empty board).
+struct BenchCase {
+    const char *name;
+    int max_depth;
+    int dice[9];
+};
+
+const BenchCase bench_corpus[] = {
+    {"trivial", 1, {6, 1, 6, 1, 0, 1, 6, 1, 6}},
+    {"shallow", 8, {6, 0, 6, 0, 0, 0, 6, 1, 5}},
+    {"medium", 20, {0, 5, 1, 0, 0, 0, 4, 0, 1}},
+    {"deep", 32, {0, 0, 0, 0, 5, 4, 1, 0, 5}},
+    {"deeper", 40, {0, 5, 4, 0, 3, 0, 0, 3, 0}},
+    {"sparse", 60, {0, 5, 1, 0, 0, 0, 4, 0, 1}},
+    {"empty_board", 40, {0, 0, 0, 0, 0, 0, 0, 0, 0}},
+    {"worst", 80, {0, 0, 0, 0, 0, 0, 0, 0, 0}},
+};
+
+// Runs every case `repeat` times with the selected solver and prints one JSON object per case on
+// stdout: best wall time plus the totals of the per-depth profile of the last run.
+void run_bench(const int repeat) {
+    collect_profile = true;
+    for (const BenchCase &bench : bench_corpus) {
+        max_depth = bench.max_depth;
+        State initial_state = 0;
+        for (int i = 0; i < 9; i++)
+            initial_state = SET_DIE_VALUE(initial_state, i, State(bench.dice[i]));
+        double best = 1e300;
+        uint32_t answer = 0;
+        for (int r = 0; r < repeat; r++) {
+            const auto start = std::chrono::steady_clock::now();
+            answer = solve(initial_state) % MOD;
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        uint64_t max_layer = 0, final_states = 0;
+        ProbeStats probes;
+        for (const DepthProfile &profile : depth_profiles) {
+            max_layer = std::max(max_layer, profile.layer_size);
+            final_states += profile.final_states;
+            probes.add(profile.probes);
+        }
+        std::cout << "{\"case\":\"" << bench.name << "\""
+                  << ",\"max_depth\":" << bench.max_depth
+                  << ",\"solver\":\"" << (use_memo ? "memo" : engine_names[engine]) << "\""
+                  << ",\"threads\":" << thread_count
+                  << ",\"answer\":" << answer
+                  << ",\"ms\":" << best
+                  << ",\"depths\":" << depth_profiles.size()
+                  << ",\"max_layer\":" << max_layer
+                  << ",\"final_states\":" << final_states
+                  << ",\"lookups\":" << probes.lookups
+                  << ",\"avg_probe\":" << (probes.lookups ? double(probes.groups) / probes.lookups : 0.0)
+                  << ",\"max_probe\":" << probes.max_groups
+                  << ",\"rehashes\":" << probes.rehashes
+                  << ",\"storage_growths\":" << probes.storage_growths << "}" << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    // --threads N: split every depth layer across N workers (0 = all cores).
+    // --stats: print the HashTable probe counters (in groups of 16 slots) to stderr.
+    // --movegen classic|table: pick the move generator, for A/B timing.
+    // --solver bfs|memo: layer sweep (default) or memoized depth-first search.
+    // --batch [FILE]: answer every (depth, board) record of FILE (or stdin), one line each.
+    // --engine hash|dense|sort|spill: layer storage, HashTable (default), rank-indexed DenseLayer,
+    //     radix-sorted SortedLayer or partitioned files on disk.
+    // --spill-dir DIR, --partitions N, --resume: where the spill engine writes its layers, in how
+    //     many files per layer, and whether to restart from the checkpoint left in DIR.
+    // --rank-cache FILE: load the dense ranking from FILE, or build it and save it there.
+    // --compare-engines: time every layer engine on a built-in corpus of deep inputs.
+    // --profile: print one JSON line per depth (layer size, final states, load factor, probes,
+    //     storage growths, time) to stderr after every query.
+    // --bench [REPEAT]: run the built-in benchmark corpus, one JSON line per case on stdout.
+    // --board WxH, --cap N: solve a compiled BoardVariant instead (max_depth, then W*H dice).
+    bool print_stats = false;
+    bool batch = false;
+    const char *batch_path = nullptr;
+    bool compare = false;
+    int bench_repeat = 0;
+    int board_width = 0, board_height = 0, board_cap = 6;
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--threads") && a + 1 < argc)
+            thread_count = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--stats"))
+            print_stats = true;
+        else if (!strcmp(argv[a], "--movegen") && a + 1 < argc)
+            use_move_table = strcmp(argv[++a], "classic") != 0;
+        else if (!strcmp(argv[a], "--solver") && a + 1 < argc)
+            use_memo = !strcmp(argv[++a], "memo");
+        else if (!strcmp(argv[a], "--batch")) {
+            batch = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-')
+                batch_path = argv[++a];
+        }
+        else if (!strcmp(argv[a], "--engine") && a + 1 < argc) {
+            const char *name = argv[++a];
+            engine = !strcmp(name, "dense") ? ENGINE_DENSE : !strcmp(name, "sort") ? ENGINE_SORT :
+                     !strcmp(name, "spill") ? ENGINE_SPILL : ENGINE_HASH;
+        }
+        else if (!strcmp(argv[a], "--spill-dir") && a + 1 < argc)
+            spill_directory = argv[++a];
+        else if (!strcmp(argv[a], "--partitions") && a + 1 < argc)
+            spill_partitions = std::max(1, atoi(argv[++a]));
+        else if (!strcmp(argv[a], "--resume"))
+            spill_resume = true;
+        else if (!strcmp(argv[a], "--compare-engines"))
+            compare = true;
+        else if (!strcmp(argv[a], "--profile"))
+            print_profile = collect_profile = true;
+        else if (!strcmp(argv[a], "--bench")) {
+            bench_repeat = 1;
+            if (a + 1 < argc && argv[a + 1][0] != '-')
+                bench_repeat = std::max(1, atoi(argv[++a]));
+        }
+        else if (!strcmp(argv[a], "--rank-cache") && a + 1 < argc)
+            rank_cache = argv[++a];
+        else if (!strcmp(argv[a], "--board") && a + 1 < argc)
+            sscanf(argv[++a], "%dx%d", &board_width, &board_height);
+        else if (!strcmp(argv[a], "--cap") && a + 1 < argc)
+            board_cap = atoi(argv[++a]);
+    }
+    if (thread_count <= 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    if (compare) {
+        compare_engines();
+        return 0;
+    }
+    if (board_width > 0 && board_height > 0) {
+        std::vector<int> cells(board_width * board_height);
+        std::cin >> max_depth;
+        for (int &cell : cells)
+            std::cin >> cell;
+        uint32_t sum;
+        if (!run_variant(board_width, board_height, board_cap, cells.data(), max_depth, sum)) {
+            std::cerr << "no compiled variant for " << board_width << "x" << board_height << " cap " << board_cap << std::endl;
+            return 1;
+        }
+        std::cout << sum % MOD << std::endl;
+        return 0;
+    }
+    prepare_engine();
+
+    if (bench_repeat) {
+        run_bench(bench_repeat);
+    } else if (batch) {
+        if (batch_path) {
+            std::ifstream file(batch_path);
+            if (!file) {
+                std::cerr << "cannot open " << batch_path << std::endl;
+                return 1;
+            }
+            run_batch(file);
+        } else {
+            run_batch(std::cin);
+        }
+    } else {
+        State initial_state = 0;
+        std::cin >> max_depth; std::cin.ignore();
+        for (int i = 0; i < 9; i++) {
+            State value;
+            std::cin >> value; std::cin.ignore();
+            initial_state = SET_DIE_VALUE(initial_state, i, value);
+        }
+        final_sum = solve(initial_state);
+        std::cout << compute_final_sum() << std::endl;
+        report_profile();
+    }
 
-    std::cout << compute_final_sum() << std::endl;
+    if (print_stats)
+        print_probe_stats();
+    delete parallel_search;
+    delete dense_search;
+    delete state_ranking;
+    delete sort_search;
+    delete spill_search;
 }
@@ -1,16 +1,17 @@
 #undef _GLIBCXX_DEBUG                // disable run-time bound checking, etc
 #pragma GCC optimize("Ofast,inline") // Ofast = O3,fast-math,allow-store-data-races,no-protect-parens
 
-#pragma GCC target("bmi,bmi2,lzcnt,popcnt")                      // bit manipulation
-#pragma GCC target("movbe")                                      // byte swap
-#pragma GCC target("aes,pclmul,rdrnd")                           // encryption
-#pragma GCC target("avx,avx2,f16c,fma,sse2,sse3,ssse3,sse4.1,sse4.2") // SIMD
+// No global target pragma: the hot loops are compiled for x86-64-v4 (AVX-512), x86-64-v3
+// (AVX2, BMI2, FMA) and the baseline, and the loader picks one from cpuid at startup. flatten
+// inlines the simulators into each clone: an out-of-line callee is only built for the baseline.
+#define MULTIVERSION __attribute__((flatten, target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
 #include <limits.h>
+#include <pthread.h>
 
 #define MAX_WIDTH  20
 #define MAX_HEIGHT 20
@@ -24,6 +25,12 @@
 #define MAX_COMMANDS_PLAYER_ENEMIE 512
 #define MAX_COMMANDS (MAX_COMMANDS_PLAYER_ME + MAX_COMMANDS_PLAYER_ENEMIE)
 #define MAX_SIMULATIONS 4096
+#define MAX_CELLS (MAX_WIDTH * MAX_HEIGHT)
+#define CELL_INDEX(x, y) ((y) * MAX_WIDTH + (x))
+#define UNREACHABLE 9999
+#define MAX_THREADS 64
+#define TOP_RESULTS 64   // simulation_results entries kept sorted by compute_evaluation
+#define KILLER_REPLIES 4 // enemy replies that refuted recent rows, tried first
 
 typedef enum {
     CMD_SHOOT,
@@ -47,8 +54,29 @@ typedef struct {
     int op_cmds_index;
 } SimulationResult;
 
+// Voronoi split of the free cells for the current turn, distances as in
+// controlled_score_gain_if_agent_moves_to (Manhattan, doubled for agents at wetness >= 50).
 typedef struct {
-    int bfs_enemy_distances[MAX_AGENTS][MAX_HEIGHT][MAX_WIDTH];
+    int my_best[MAX_CELLS];        // nearest friendly agent
+    int my_best_agent[MAX_CELLS];
+    int my_second[MAX_CELLS];      // nearest friendly agent other than my_best_agent
+    int en_best[MAX_CELLS];        // nearest enemy agent
+    int en_best_agent[MAX_CELLS];
+    int en_second[MAX_CELLS];      // nearest enemy agent other than en_best_agent
+    int owner[MAX_CELLS];          // +1 mine, -1 enemy, 0 tied
+    int score;                     // sum of owner
+    // cells whose owner can change when the agent takes one step
+    short influence[MAX_AGENTS][MAX_CELLS];
+    int influence_count[MAX_AGENTS];
+    // territory_delta results already computed this turn, one per destination of an agent
+    short cached_cell[MAX_AGENTS][MAX_MOVES_PER_AGENT];
+    int cached_delta[MAX_AGENTS][MAX_MOVES_PER_AGENT];
+    int cached_count[MAX_AGENTS];
+    bool frozen;   // set while evaluation threads read the cache
+} Territory;
+
+typedef struct {
+    Territory territory;
     AgentAction moves[MAX_AGENTS][MAX_MOVES_PER_AGENT];
     int move_counts[MAX_AGENTS];
     AgentAction shoots[MAX_AGENTS][MAX_SHOOTS_PER_AGENT];
@@ -57,10 +85,21 @@ typedef struct {
     int bomb_counts[MAX_AGENTS];
     AgentCommand agent_commands[MAX_AGENTS][MAX_COMMANDS_PER_AGENT];
     int agent_command_counts[MAX_AGENTS];
-    AgentCommand player_commands[MAX_PLAYERS][MAX_COMMANDS][MAX_AGENTS];
+    // joint commands as one agent_commands index per agent, read through PLAYER_COMMAND
+    unsigned char player_commands[MAX_PLAYERS][MAX_COMMANDS][MAX_AGENTS];
     int player_command_count[MAX_PLAYERS];
     SimulationResult simulation_results[MAX_SIMULATIONS];
     int simulation_count;
+    int sorted_count;   // rows at the front of simulation_results that are the true best, in order
+    long long simulations;   // simulate_players_commands calls of the last compute_evaluation
+    long long pruned_simulations;   // skipped by compute_evaluation's cut-offs
+    long long turn_simulations;   // simulations of every round and beam node of the turn
+    int player_command_limit[MAX_PLAYERS];   // joint commands per player in the current round
+    bool evaluation_aborted;   // the deadline hit compute_evaluation before every row was done
+    AgentCommand best_commands[MAX_AGENTS];  // answer of the last complete round
+    float best_score;
+    int search_rounds;
+    double evaluation_ms;
 } GameOutput;
 
 typedef struct {
@@ -82,6 +121,42 @@ typedef struct {
     int type;
 } Tile;
 
+// One bit per cell, a row per word with BB_PAD cells of margin on every side, so neighbourhood
+// queries at and just off the border need no bounds check: cell (x, y) is bit x + BB_PAD of
+// rows[y + BB_PAD].
+#define BB_PAD 2
+#define BB_ROWS (MAX_HEIGHT + 2 * BB_PAD)
+typedef struct {
+    unsigned int rows[BB_ROWS];
+} Bitboard;
+#define BB_TEST(bb, x, y) (((bb)->rows[(y) + BB_PAD] >> ((x) + BB_PAD)) & 1u)
+#define BB_SET(bb, x, y)  ((bb)->rows[(y) + BB_PAD] |= 1u << ((x) + BB_PAD))
+#define BB_CLEAR(bb, x, y) ((bb)->rows[(y) + BB_PAD] &= ~(1u << ((x) + BB_PAD)))
+
+// Set cells in the 3x3 square around (x, y).
+static inline int bb_count_3x3(const Bitboard* bb, int x, int y) {
+    const unsigned int* r = &bb->rows[y + BB_PAD];
+    int shift = x + BB_PAD - 1;
+    return __builtin_popcount((r[-1] >> shift) & 7u) + __builtin_popcount((r[0] >> shift) & 7u) +
+           __builtin_popcount((r[1] >> shift) & 7u);
+}
+
+static inline bool bb_any_3x3(const Bitboard* bb, int x, int y) {
+    const unsigned int* r = &bb->rows[y + BB_PAD];
+    int shift = x + BB_PAD - 1;
+    return ((r[-1] | r[0] | r[1]) >> shift) & 7u;
+}
+
+// in plus its 4-neighbours, one shift per direction.
+static inline void bb_dilate_4(const Bitboard* in, Bitboard* out) {
+    out->rows[0] = in->rows[0] | in->rows[1];
+    for (int r = 1; r < BB_ROWS - 1; r++) {
+        unsigned int row = in->rows[r];
+        out->rows[r] = row | (row << 1) | (row >> 1) | in->rows[r - 1] | in->rows[r + 1];
+    }
+    out->rows[BB_ROWS - 1] = in->rows[BB_ROWS - 1] | in->rows[BB_ROWS - 2];
+}
+
 typedef struct {
     int id;
     int x, y;
@@ -94,6 +169,14 @@ typedef struct {
 typedef struct {
     int width, height;
     Tile map[MAX_HEIGHT][MAX_WIDTH];
+    // walking distance between every pair of cells (CELL_INDEX), UNREACHABLE if walled off
+    unsigned short distances[MAX_CELLS][MAX_CELLS];
+    short free_cells[MAX_CELLS];   // CELL_INDEX of every tile without cover
+    int free_cell_count;
+    int cover_quarters[MAX_CELLS]; // shot damage multiplier in quarters behind each tile: 4, 2 or 1
+    Bitboard solid;                // cover tiles and every cell off the board: no walking there
+    Bitboard low_cover;
+    Bitboard high_cover;
 } MapInfo;
 
 typedef struct {
@@ -106,6 +189,7 @@ typedef struct {
 
 typedef struct {
     AgentState agents[MAX_AGENTS];
+    Bitboard occupancy[MAX_PLAYERS];   // cells of the alive agents of each player
     int agent_count_do_not_use;
     int my_agent_count_do_not_use;
 } GameState;
@@ -118,13 +202,90 @@ typedef struct {
 
 GameInfo game = {0};
 
-static clock_t gCPUStart;
-#define CPU_RESET        (gCPUStart = clock())
-#define CPU_MS_USED      (((double)(clock() - gCPUStart)) * 1000.0 / CLOCKS_PER_SEC)
-#define CPU_BREAK(val)   if (CPU_MS_USED > (val)) break;
+// The AgentCommand of agent aid in joint command cmd_index of player p.
+#define PLAYER_COMMAND(p, cmd_index, aid) \
+    (&game.output.agent_commands[aid][game.output.player_commands[p][cmd_index][aid]])
+
+// Turn timer on the monotonic clock: the judge counts wall time, and clock() sums the CPU time of
+// every evaluation thread.
+static double gCPUStart;
+#define CPU_RESET        (gCPUStart = wall_ms())
+#define CPU_MS_USED      (wall_ms() - gCPUStart)
+int turn_count = 0;
 #define ERROR(text) {fprintf(stderr,"ERROR:%s",text);fflush(stderr);exit(1);}
 #define ERROR_INT(text,val) {fprintf(stderr,"ERROR:%s:%d",text,val);fflush(stderr);exit(1);}
 
+static double wall_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Persistent workers for compute_evaluation (--threads N). The calling thread runs part 0 of
+// every job, so thread_count 1 means no worker at all.
+typedef struct {
+    pthread_t threads[MAX_THREADS];
+    int thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int generation;
+    int pending;
+    void (*job)(int part, int parts, const void* arg);
+    const void* arg;
+} ThreadPool;
+
+ThreadPool pool = {.thread_count = 1, .mutex = PTHREAD_MUTEX_INITIALIZER,
+                   .start = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+
+static void* pool_worker(void* arg) {
+    int part = (int)(long)arg;
+    int seen = 0;
+    while (1) {
+        pthread_mutex_lock(&pool.mutex);
+        while (pool.generation == seen) pthread_cond_wait(&pool.start, &pool.mutex);
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.mutex);
+
+        pool.job(part, pool.thread_count, pool.arg);
+
+        pthread_mutex_lock(&pool.mutex);
+        if (--pool.pending == 0) pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+    return NULL;
+}
+
+void pool_start(int thread_count) {
+    if (thread_count > MAX_THREADS) thread_count = MAX_THREADS;
+    if (thread_count < 1) thread_count = 1;
+    pool.thread_count = thread_count;
+    for (int t = 1; t < thread_count; t++) {
+        if (pthread_create(&pool.threads[t], NULL, pool_worker, (void*)(long)t)) ERROR_INT("pthread_create", t)
+    }
+}
+
+// Runs job(part, parts, arg) for every part and returns when all of them are done.
+void pool_run(void (*job)(int part, int parts, const void* arg), const void* arg) {
+    if (pool.thread_count == 1) {
+        job(0, 1, arg);
+        return;
+    }
+    pthread_mutex_lock(&pool.mutex);
+    pool.job = job;
+    pool.arg = arg;
+    pool.pending = pool.thread_count - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+
+    job(0, pool.thread_count, arg);
+
+    pthread_mutex_lock(&pool.mutex);
+    while (pool.pending > 0) pthread_cond_wait(&pool.done, &pool.mutex);
+    pthread_mutex_unlock(&pool.mutex);
+}
+
 void debug_stats() {
     fprintf(stderr, "\n=== STATS ===\n");
 
@@ -138,50 +299,186 @@ void debug_stats() {
     }
 
     // Simulations
-    fprintf(stderr, "Simulations: %d\n", game.output.simulation_count);
+    fprintf(stderr, "Simulations: %d rows, %lld sims, %lld pruned, %.1f sims/ms\n", game.output.simulation_count,
+            game.output.simulations, game.output.pruned_simulations,
+            game.output.evaluation_ms > 0 ? game.output.simulations / game.output.evaluation_ms : 0.0);
     fprintf(stderr, "=============\n");
 }
 
 
-int controlled_score_gain_if_agent_moves_to(int agent_id, int nx, int ny) {
-    int my_gain = 0;
-    int enemy_gain = 0;
+// The map never changes: one flood fill per free cell at init, then every distance is a table
+// lookup. Each step dilates the reached cells by one and keeps the free ones not reached before.
+void precompute_map_distances() {
+    Bitboard free_cells;
+    for (int r = 0; r < BB_ROWS; r++) free_cells.rows[r] = ~game.consts.map.solid.rows[r];
 
-    for (int y = 0; y < game.consts.map.height; y++) {
-        for (int x = 0; x < game.consts.map.width; x++) {
-            if (game.consts.map.map[y][x].type > 0) continue;
-
-            int d_my = INT_MAX;
-            int d_en = INT_MAX;
-
-            for (int i = game.consts.player_info[game.consts.my_player_id].agent_start_index;
-                 i <= game.consts.player_info[game.consts.my_player_id].agent_stop_index; i++) {
-                if (!game.state.agents[i].alive) continue;
-                int ax = (i == agent_id) ? nx : game.state.agents[i].x;
-                int ay = (i == agent_id) ? ny : game.state.agents[i].y;
-                int d = abs(x - ax) + abs(y - ay);
-                if (game.state.agents[i].wetness >= 50) d *= 2;
-                if (d < d_my) d_my = d;
+    for (int from = 0; from < MAX_CELLS; from++) {
+        for (int to = 0; to < MAX_CELLS; to++) {
+            game.consts.map.distances[from][to] = UNREACHABLE;
+        }
+    }
+
+    for (int f = 0; f < game.consts.map.free_cell_count; f++) {
+        int source = game.consts.map.free_cells[f];
+        unsigned short* dist = game.consts.map.distances[source];
+        Bitboard reached = {{0}}, grown;
+        BB_SET(&reached, source % MAX_WIDTH, source / MAX_WIDTH);
+        dist[source] = 0;
+
+        for (int d = 1; ; d++) {
+            bb_dilate_4(&reached, &grown);
+            bool any = false;
+            for (int r = 0; r < BB_ROWS; r++) {
+                unsigned int fresh = grown.rows[r] & free_cells.rows[r] & ~reached.rows[r];
+                reached.rows[r] |= fresh;
+                any |= fresh != 0;
+                while (fresh) {
+                    int x = __builtin_ctz(fresh) - BB_PAD;
+                    fresh &= fresh - 1;
+                    dist[CELL_INDEX(x, r - BB_PAD)] = d;
+                }
             }
+            if (!any) break;
+        }
+    }
+}
+
+static inline int map_distance(int x1, int y1, int x2, int y2) {
+    return game.consts.map.distances[CELL_INDEX(x1, y1)][CELL_INDEX(x2, y2)];
+}
+
+static inline int territory_distance(const AgentState* agent, int ax, int ay, int cell) {
+    int d = abs(cell % MAX_WIDTH - ax) + abs(cell / MAX_WIDTH - ay);
+    return (agent->wetness >= 50) ? 2 * d : d;
+}
 
-            for (int i = game.consts.player_info[!game.consts.my_player_id].agent_start_index;
-                 i <= game.consts.player_info[!game.consts.my_player_id].agent_stop_index; i++) {
-                if (!game.state.agents[i].alive) continue;
-                int ax = game.state.agents[i].x;
-                int ay = game.state.agents[i].y;
-                // int ax = (i == agent_id) ? nx : game.state.agents[i].x;
-                // int ay = (i == agent_id) ? ny : game.state.agents[i].y;
-                int d = abs(x - ax) + abs(y - ay);
-                if (game.state.agents[i].wetness >= 50) d *= 2;
-                if (d < d_en) d_en = d;
+// Once per turn, agents at their current positions: O(cells * agents). Every candidate move is
+// then a delta in territory_delta.
+void compute_territory() {
+    Territory* t = &game.output.territory;
+    int my_id = game.consts.my_player_id;
+    int my_start = game.consts.player_info[my_id].agent_start_index;
+    int my_stop  = game.consts.player_info[my_id].agent_stop_index;
+    int en_start = game.consts.player_info[!my_id].agent_start_index;
+    int en_stop  = game.consts.player_info[!my_id].agent_stop_index;
+
+    t->score = 0;
+    t->frozen = false;
+    for (int i = 0; i < MAX_AGENTS; i++) {
+        t->influence_count[i] = 0;
+        t->cached_count[i] = 0;
+    }
+
+    for (int f = 0; f < game.consts.map.free_cell_count; f++) {
+        int cell = game.consts.map.free_cells[f];
+        int best = INT_MAX, best_agent = -1, second = INT_MAX;
+        int en_best = INT_MAX, en_best_agent = -1, en_second = INT_MAX;
+
+        for (int i = my_start; i <= my_stop; i++) {
+            AgentState* agent = &game.state.agents[i];
+            if (!agent->alive) continue;
+            int d = territory_distance(agent, agent->x, agent->y, cell);
+            if (d < best) {
+                second = best;
+                best = d;
+                best_agent = i;
+            } else if (d < second) {
+                second = d;
+            }
+        }
+        for (int i = en_start; i <= en_stop; i++) {
+            AgentState* agent = &game.state.agents[i];
+            if (!agent->alive) continue;
+            int d = territory_distance(agent, agent->x, agent->y, cell);
+            if (d < en_best) {
+                en_second = en_best;
+                en_best = d;
+                en_best_agent = i;
+            } else if (d < en_second) {
+                en_second = d;
             }
+        }
+
+        t->my_best[cell] = best;
+        t->my_best_agent[cell] = best_agent;
+        t->my_second[cell] = second;
+        t->en_best[cell] = en_best;
+        t->en_best_agent[cell] = en_best_agent;
+        t->en_second[cell] = en_second;
+        t->owner[cell] = (best < en_best) - (en_best < best);
+        t->score += t->owner[cell];
+
+        // One step changes an agent's distance by at most its multiplier, so the nearest distance of
+        // its side can only change where the agent is within that margin of its teammates.
+        for (int i = 0; i < MAX_AGENTS; i++) {
+            AgentState* agent = &game.state.agents[i];
+            if (!agent->alive) continue;
+            int without;
+            if (i >= my_start && i <= my_stop) without = (i == best_agent) ? second : best;
+            else if (i >= en_start && i <= en_stop) without = (i == en_best_agent) ? en_second : en_best;
+            else continue;
+            int margin = (agent->wetness >= 50) ? 2 : 1;
+            if (territory_distance(agent, agent->x, agent->y, cell) - margin <= without)
+                t->influence[i][t->influence_count[i]++] = cell;
+        }
+    }
+}
+
+// Change of the territory balance (my cells - enemy cells) if the agent, of either side, moves
+// one step to (nx, ny) and everyone else stays. Only the agent's influence cells are rescanned,
+// once per destination: the simulator asks again for every joint command.
+int territory_delta(int agent_id, int nx, int ny) {
+    Territory* t = &game.output.territory;
+    int target = CELL_INDEX(nx, ny);
+    for (int k = 0; k < t->cached_count[agent_id]; k++) {
+        if (t->cached_cell[agent_id][k] == target) return t->cached_delta[agent_id][k];
+    }
 
-            if (d_my < d_en) my_gain++;
-            else if (d_en < d_my) enemy_gain++;
+    AgentState* agent = &game.state.agents[agent_id];
+    bool mine = game.consts.agent_info[agent_id].player_id == game.consts.my_player_id;
+    int delta = 0;
+    for (int k = 0; k < t->influence_count[agent_id]; k++) {
+        int cell = t->influence[agent_id][k];
+        int d_my = t->my_best[cell];
+        int d_en = t->en_best[cell];
+        int d = territory_distance(agent, nx, ny, cell);
+        if (mine) {
+            d_my = (t->my_best_agent[cell] == agent_id) ? t->my_second[cell] : d_my;
+            if (d < d_my) d_my = d;
+        } else {
+            d_en = (t->en_best_agent[cell] == agent_id) ? t->en_second[cell] : d_en;
+            if (d < d_en) d_en = d;
         }
+        delta += ((d_my < d_en) - (d_en < d_my)) - t->owner[cell];
+    }
+    if (!t->frozen && t->cached_count[agent_id] < MAX_MOVES_PER_AGENT) {
+        t->cached_cell[agent_id][t->cached_count[agent_id]] = target;
+        t->cached_delta[agent_id][t->cached_count[agent_id]++] = delta;
     }
+    return delta;
+}
+
+// Territory balance if the friendly agent moves one step to (nx, ny) and everyone else stays.
+// Enemy moves are not scored here, only in the simulator, but their deltas are cached on the way.
+int controlled_score_gain_if_agent_moves_to(int agent_id, int nx, int ny) {
+    Territory* t = &game.output.territory;
+    int delta = territory_delta(agent_id, nx, ny);
+    if (game.consts.agent_info[agent_id].player_id != game.consts.my_player_id) return t->score;
+    return t->score + delta;
+}
 
-    return my_gain - enemy_gain;
+// Territory balance after a simulated turn: the turn's balance once plus the one-step delta of
+// every agent, friendly or enemy, that moved and is still alive. Deltas of agents whose influence
+// cells overlap are simply added.
+static inline int joint_territory_balance(const AgentState sim_agents[MAX_AGENTS]) {
+    int balance = game.output.territory.score;
+    for (int aid = 0; aid < MAX_AGENTS; aid++) {
+        const AgentState* agent = &sim_agents[aid];
+        if (!agent->alive) continue;
+        if (agent->x == game.state.agents[aid].x && agent->y == game.state.agents[aid].y) continue;
+        balance += territory_delta(aid, agent->x, agent->y);
+    }
+    return balance;
 }
 
 void read_game_inputs_init() {
@@ -222,12 +519,27 @@ void read_game_inputs_init() {
         scanf("%d%d%d", &x, &y, &tile_type);
         game.consts.map.map[y][x] = (Tile){x, y, tile_type};
     }
+    game.consts.map.free_cell_count = 0;
+    for (int r = 0; r < BB_ROWS; r++) game.consts.map.solid.rows[r] = ~0u;
+    for (int y = 0; y < game.consts.map.height; y++) {
+        for (int x = 0; x < game.consts.map.width; x++) {
+            int tile = game.consts.map.map[y][x].type;
+            game.consts.map.cover_quarters[CELL_INDEX(x, y)] = (tile == 1) ? 2 : (tile == 2) ? 1 : 4;
+            if (tile == 1) BB_SET(&game.consts.map.low_cover, x, y);
+            if (tile == 2) BB_SET(&game.consts.map.high_cover, x, y);
+            if (tile > 0) continue;
+            BB_CLEAR(&game.consts.map.solid, x, y);
+            game.consts.map.free_cells[game.consts.map.free_cell_count++] = CELL_INDEX(x, y);
+        }
+    }
+    precompute_map_distances();
 }
 
 void read_game_inputs_cycle() {    
     for (int i = 0; i < MAX_AGENTS; i++) {
         game.state.agents[i].alive = 0;
     }
+    memset(game.state.occupancy, 0, sizeof(game.state.occupancy));
     scanf("%d", &game.state.agent_count_do_not_use);
     int agent_id,agent_x,agent_y,agent_cooldown,agent_splash_bombs,agent_wetness;
     for (int i = 0; i < game.state.agent_count_do_not_use; i++) {
@@ -241,65 +553,14 @@ void read_game_inputs_cycle() {
         // index start at 1
         agent_id = agent_id -1;
         game.state.agents[agent_id] = (AgentState){agent_id,agent_x,agent_y,agent_cooldown,agent_splash_bombs,agent_wetness,1};
+        BB_SET(&game.state.occupancy[game.consts.agent_info[agent_id].player_id], agent_x, agent_y);
     }
 
     scanf("%d", &game.state.my_agent_count_do_not_use);
     CPU_RESET;
+    turn_count++;
 }
 
-void precompute_bfs_distances() {
-    static const int dirs[4][2] = {{0,1},{1,0},{0,-1},{-1,0}};
-
-    for (int k = 0; k < MAX_AGENTS; k++) {
-        AgentState* enemy = &game.state.agents[k];
-        if (!enemy->alive) continue;
-
-        int eid = enemy->id;
-        int visited[MAX_HEIGHT][MAX_WIDTH] = {0};
-        int dist[MAX_HEIGHT][MAX_WIDTH] = {0};
-
-        int queue_x[MAX_WIDTH * MAX_HEIGHT];
-        int queue_y[MAX_WIDTH * MAX_HEIGHT];
-        int front = 0, back = 0;
-
-        visited[enemy->y][enemy->x] = 1;
-        dist[enemy->y][enemy->x] = 0;
-        queue_x[back] = enemy->x;
-        queue_y[back++] = enemy->y;
-
-        while (front < back) {
-            int x = queue_x[front];
-            int y = queue_y[front++];
-            for (int d = 0; d < 4; d++) {
-                int nx = x + dirs[d][0];
-                int ny = y + dirs[d][1];
-                if (nx < 0 || nx >= game.consts.map.width || ny < 0 || ny >= game.consts.map.height)
-                    continue;
-                if (game.consts.map.map[ny][nx].type > 0) continue;
-                if (visited[ny][nx]) continue;
-
-                visited[ny][nx] = 1;
-                dist[ny][nx] = dist[y][x] + 1;
-
-                queue_x[back] = nx;
-                queue_y[back++] = ny;
-            }
-        }
-
-        for (int y = 0; y < game.consts.map.height; y++) {
-            for (int x = 0; x < game.consts.map.width; x++) {
-                if (!visited[y][x])
-                    game.output.bfs_enemy_distances[eid][y][x] = 9999;
-                else
-                    game.output.bfs_enemy_distances[eid][y][x] = dist[y][x];
-            }
-        }
-    }
-}
-
-
-
-
 void compute_best_agents_moves(int agent_id) {
     static const int dirs[5][2] = {
         {0, 0},   // stay in place
@@ -340,15 +601,14 @@ void compute_best_agents_moves(int agent_id) {
         int nx = agent_state->x + dirs[d][0];
         int ny = agent_state->y + dirs[d][1];
 
-        if (nx < 0 || nx >= game.consts.map.width || ny < 0 || ny >= game.consts.map.height) continue;
-        if (game.consts.map.map[ny][nx].type > 0) continue;
+        if (BB_TEST(&game.consts.map.solid, nx, ny)) continue;
 
-        int min_dist_to_enemy = 9999;
+        int min_dist_to_enemy = UNREACHABLE;
         for (int k = enemy_start; k <= enemy_stop; k++) {
             AgentState* op_state = &game.state.agents[k];
             if (!op_state->alive) continue;
 
-            int dist = game.output.bfs_enemy_distances[op_state->id][ny][nx];
+            int dist = map_distance(op_state->x, op_state->y, nx, ny);
             if (dist < min_dist_to_enemy) min_dist_to_enemy = dist;
         }
 
@@ -454,38 +714,20 @@ void compute_best_agents_shoot(int agent_id,int new_shooter_x,int new_shooter_y)
 }
 
 bool is_blocked(int x, int y,int thrower_x, int thrower_y) {
-    if (x < 0 || x >= game.consts.map.width || y < 0 || y >= game.consts.map.height) return true;
-    if (game.consts.map.map[y][x].type > 0) return true;
+    if (BB_TEST(&game.consts.map.solid, x, y)) return true;
     if (x == thrower_x && y == thrower_y) return true;
     return false;
 }
 
+// Off-board, cover and thrower cells in the splash square around (cx, cy).
 int count_penalties(int cx, int cy,  int thrower_x, int thrower_y) {
-    int penalty = 0;
-    for (int ox = -1; ox <= 1; ++ox) {
-        for (int oy = -1; oy <= 1; ++oy) {
-            int nx = cx + ox;
-            int ny = cy + oy;
-            if (nx < 0 || nx >= game.consts.map.width || ny < 0 || ny >= game.consts.map.height) {
-                penalty++;
-            } else if ((game.consts.map.map[ny][nx].type > 0) || (nx == thrower_x && ny == thrower_y)) {
-                penalty++;
-            }
-        }
-    }
+    int penalty = bb_count_3x3(&game.consts.map.solid, cx, cy);
+    if (abs(thrower_x - cx) <= 1 && abs(thrower_y - cy) <= 1) penalty++;
     return penalty;
 }
 
-bool zone_touche_allie(int cx, int cy, int player_id, AgentState agents[]) {
-    for (int a = game.consts.player_info[player_id].agent_start_index;
-         a <= game.consts.player_info[player_id].agent_stop_index; ++a) {
-        AgentState* ally = &agents[a];
-        if (!ally->alive) continue;
-        if (abs(ally->x - cx) <= 1 && abs(ally->y - cy) <= 1) {
-            return true;
-        }
-    }
-    return false;
+bool zone_touche_allie(int cx, int cy, int player_id) {
+    return bb_any_3x3(&game.state.occupancy[player_id], cx, cy);
 }
 
 
@@ -516,6 +758,8 @@ void compute_best_agents_bomb(int agent_id, int new_thrower_x, int new_thrower_y
         for (int d = 0; d < 5; ++d) {
             int tx = ex + dxs[d];
             int ty = ey + dys[d];
+            // An enemy on the edge has neighbours off the map, and THROW to them is an invalid command.
+            if (tx < 0 || tx >= game.consts.map.width || ty < 0 || ty >= game.consts.map.height) continue;
 
             if (d > 0) {
                 int ox = ex - dxs[d];
@@ -526,7 +770,7 @@ void compute_best_agents_bomb(int agent_id, int new_thrower_x, int new_thrower_y
             int dist = abs(tx - new_thrower_x) + abs(ty - new_thrower_y);
             if (dist > 4) continue;
 
-            if (zone_touche_allie(tx, ty, my_player_id, agents)) continue;
+            if (zone_touche_allie(tx, ty, my_player_id)) continue;
 
             // Score
             int score = 100 - enemy->wetness - count_penalties(tx, ty, new_thrower_x, new_thrower_y);
@@ -625,105 +869,124 @@ void compute_best_agents_commands() {
         game.output.agent_command_counts[i] = cmd_index;
     }
 }
-int check_mv_collision(int my_player_id, int cmds_index, int agent_start_id, int agent_stop_id) {
-    for (int a1 = agent_start_id; a1 <= agent_stop_id; a1++) {
-        if (!game.state.agents[a1].alive) continue;
-        AgentCommand *cmd1 = &game.output.player_commands[my_player_id][cmds_index][a1];
-        int from1_x = game.state.agents[a1].x;
-        int from1_y = game.state.agents[a1].y;
-        int to1_x = cmd1->mv_x;
-        int to1_y = cmd1->mv_y;
-
-        for (int a2 = a1 + 1; a2 <= agent_stop_id; a2++) {
-            if (!game.state.agents[a2].alive) continue;
-            AgentCommand *cmd2 = &game.output.player_commands[my_player_id][cmds_index][a2];
-            int from2_x = game.state.agents[a2].x;
-            int from2_y = game.state.agents[a2].y;
-            int to2_x = cmd2->mv_x;
-            int to2_y = cmd2->mv_y;
-
-            if (to1_x == to2_x && to1_y == to2_y) {
-                // fprintf(stderr,"collision a:%d-a:%d x:%d y:%d\n",a1,a2,to1_x,to1_y);
-                return 1;
-            }
-            if (to1_x == from2_x && to1_y == from2_y && to2_x == from1_x && to2_y == from1_y) {
-                
-                // fprintf(stderr,"swap a:%d-a:%d x:%d y:%d\n",a1,a2,to1_x,to1_y);
-                return 1;
+// Joint commands of one player by backtracking over its alive agents, the last one outermost so
+// rows come in the order of the odometer this replaced. A destination cell already taken in the
+// prefix (occupied bitboard) or a swap with an assigned agent (swap_dest: destination of the agent
+// standing on each cell) cuts the prefix before any of its completions is built.
+typedef struct {
+    int player;
+    int agents[MAX_AGENTS];
+    int agent_count;
+    int widths[MAX_AGENTS];   // first agent_commands tried per agent
+    int limit;
+    int count;
+    bool write;               // false only counts, stopping past limit
+    unsigned long long occupied[(MAX_CELLS + 63) / 64];
+    short swap_dest[MAX_CELLS];
+    unsigned char indices[MAX_AGENTS];
+} JointEnumerator;
+
+static void enumerate_joint_commands(JointEnumerator* e, int depth) {
+    if (e->count > e->limit) return;
+    if (depth < 0) {
+        if (e->write) {
+            for (int k = 0; k < e->agent_count; k++) {
+                int aid = e->agents[k];
+                game.output.player_commands[e->player][e->count][aid] = e->indices[aid];
             }
         }
+        e->count++;
+        return;
     }
-    return 0;
+    int aid = e->agents[depth];
+    int from = CELL_INDEX(game.state.agents[aid].x, game.state.agents[aid].y);
+    for (int c = 0; c < e->widths[aid]; c++) {
+        AgentCommand* cmd = &game.output.agent_commands[aid][c];
+        int to = CELL_INDEX(cmd->mv_x, cmd->mv_y);
+        unsigned long long bit = 1ULL << (to & 63);
+        if (e->occupied[to >> 6] & bit) continue;
+        if (e->swap_dest[to] == from) continue;
+
+        e->occupied[to >> 6] |= bit;
+        e->swap_dest[from] = to;
+        e->indices[aid] = c;
+        enumerate_joint_commands(e, depth - 1);
+        e->occupied[to >> 6] &= ~bit;
+        e->swap_dest[from] = -1;
+    }
+}
+
+static int count_joint_commands(JointEnumerator* e, bool write) {
+    e->count = 0;
+    e->write = write;
+    enumerate_joint_commands(e, e->agent_count - 1);
+    return e->count;
 }
 
+// Widths whose product fits budget, one more command per agent in turn.
+static void split_command_budget(JointEnumerator* e, int budget) {
+    int total = 1;
+    for (int k = 0; k < e->agent_count; k++) e->widths[e->agents[k]] = 1;
+    bool updated = true;
+    while (updated) {
+        updated = false;
+        for (int k = 0; k < e->agent_count; k++) {
+            int agent_id = e->agents[k];
+            int current = e->widths[agent_id];
+            if (current < game.output.agent_command_counts[agent_id]) {
+                int new_total = total / current * (current + 1);
+                if (new_total <= budget) {
+                    e->widths[agent_id]++;
+                    total = new_total;
+                    updated = true;
+                }
+            }
+        }
+    }
+}
 
+// The product split of player_command_limit loses its colliding rows, so agents then take one
+// more command each in turn as long as the valid joint commands still fit the limit.
 void compute_best_player_commands() {
+    static JointEnumerator e;
     for (int p = 0; p < MAX_PLAYERS; p++) {
-        game.output.player_command_count[p] = 0;
-
-        int max_total_cmds = (p == game.consts.my_player_id) ? MAX_COMMANDS_PLAYER_ME : MAX_COMMANDS_PLAYER_ENEMIE;
-        int agent_start_id = game.consts.player_info[p].agent_start_index;
-        int agent_stop_id = game.consts.player_info[p].agent_stop_index;
-        int max_cmds[MAX_AGENTS] = {0};
-        int total = 1;
-
-        for (int agent_id = agent_start_id; agent_id <= agent_stop_id; agent_id++) {
-            if (!game.state.agents[agent_id].alive) continue;
-            max_cmds[agent_id] = 1;
+        e.player = p;
+        e.limit = game.output.player_command_limit[p];
+        e.agent_count = 0;
+        memset(e.occupied, 0, sizeof(e.occupied));
+        for (int c = 0; c < MAX_CELLS; c++) e.swap_dest[c] = -1;
+        for (int agent_id = game.consts.player_info[p].agent_start_index; agent_id <= game.consts.player_info[p].agent_stop_index; agent_id++) {
+            if (game.state.agents[agent_id].alive) e.agents[e.agent_count++] = agent_id;
         }
+        split_command_budget(&e, e.limit);
 
-        bool updated = true;
+        bool full[MAX_AGENTS] = {false};
+        bool updated = count_joint_commands(&e, false) < e.limit;
         while (updated) {
             updated = false;
-            for (int agent_id = agent_start_id; agent_id <= agent_stop_id; agent_id++) {
-                if (!game.state.agents[agent_id].alive) continue;
-
-                int current = max_cmds[agent_id];
-                int available = game.output.agent_command_counts[agent_id];
-
-                if (current < available) {
-                    int new_total = total / current * (current + 1);
-                    if (new_total <= max_total_cmds) {
-                        max_cmds[agent_id]++;
-                        total = new_total;
-                        updated = true;
-                    }
-                }
-            }
-        }
-        int indices[MAX_AGENTS] = {0};
-
-        while (true) {
-            if (game.output.player_command_count[p] >= max_total_cmds) ERROR_INT("ERROR to many command",max_total_cmds)
-
-            for (int agent_id = agent_start_id; agent_id <= agent_stop_id; agent_id++) {
-                if (!game.state.agents[agent_id].alive) continue;
-                int cmd_id = indices[agent_id];
-                game.output.player_commands[p][game.output.player_command_count[p]][agent_id] =
-                    game.output.agent_commands[agent_id][cmd_id];
-            }
-            bool collision = check_mv_collision(p,game.output.player_command_count[p],agent_start_id,agent_stop_id);
-
-            if(!collision) game.output.player_command_count[p]++;
-
-            // game.output.player_command_count[p]++;
-            int carry = 1;
-            for (int agent_id = agent_start_id; agent_id <= agent_stop_id && carry; agent_id++) {
-                if (!game.state.agents[agent_id].alive) continue;
-
-                indices[agent_id]++;
-                if (indices[agent_id] >= max_cmds[agent_id]) {
-                    indices[agent_id] = 0;
-                    carry = 1;
+            for (int k = 0; k < e.agent_count; k++) {
+                int agent_id = e.agents[k];
+                if (full[k] || e.widths[agent_id] >= game.output.agent_command_counts[agent_id]) continue;
+                e.widths[agent_id]++;
+                if (count_joint_commands(&e, false) > e.limit) {
+                    e.widths[agent_id]--;
+                    full[k] = true;
                 } else {
-                    carry = 0;
+                    updated = true;
                 }
             }
-
-            if (carry) break;
         }
+        game.output.player_command_count[p] = count_joint_commands(&e, true);
+    }
+}
+
+// Expands joint command cmd_index of player p into out, for the alive agents of p.
+void gather_player_command(int p, int cmd_index, AgentCommand out[MAX_AGENTS]) {
+    for (int aid = game.consts.player_info[p].agent_start_index; aid <= game.consts.player_info[p].agent_stop_index; aid++) {
+        if (game.state.agents[aid].alive) out[aid] = *PLAYER_COMMAND(p, cmd_index, aid);
     }
 }
+
 typedef struct {
     AgentState sim_agents[MAX_AGENTS];
     int wetness_gain;
@@ -732,7 +995,7 @@ typedef struct {
     int control_score;
 } SimulationContext;
 
-void simulate_players_commands(int my_cmd_index, int en_cmd_index, SimulationContext* ctx) {
+static inline void simulate_players_commands(int my_cmd_index, int en_cmd_index, SimulationContext* ctx) {
     int my_id = game.consts.my_player_id;
     int en_id = !my_id;
     int my_start = game.consts.player_info[my_id].agent_start_index;
@@ -749,9 +1012,9 @@ void simulate_players_commands(int my_cmd_index, int en_cmd_index, SimulationCon
 
         AgentCommand* cmd = NULL;
         if (aid >= my_start && aid <= my_stop) {
-            cmd = &game.output.player_commands[my_id][my_cmd_index][aid];
+            cmd = PLAYER_COMMAND(my_id, my_cmd_index, aid);
         } else if (aid >= en_start && aid <= en_stop) {
-            cmd = &game.output.player_commands[en_id][en_cmd_index][aid];
+            cmd = PLAYER_COMMAND(en_id, en_cmd_index, aid);
         } else continue;
 
         ctx->sim_agents[aid].x = cmd->mv_x;
@@ -762,9 +1025,9 @@ void simulate_players_commands(int my_cmd_index, int en_cmd_index, SimulationCon
 
         AgentCommand* cmd = NULL;
         if (aid >= my_start && aid <= my_stop) {
-            cmd = &game.output.player_commands[my_id][my_cmd_index][aid];
+            cmd = PLAYER_COMMAND(my_id, my_cmd_index, aid);
         } else if (aid >= en_start && aid <= en_stop) {
-            cmd = &game.output.player_commands[en_id][en_cmd_index][aid];
+            cmd = PLAYER_COMMAND(en_id, en_cmd_index, aid);
         } else continue;
 
         if (cmd->action_type == CMD_THROW) {
@@ -795,11 +1058,8 @@ void simulate_players_commands(int my_cmd_index, int en_cmd_index, SimulationCon
             int adj_y = -((target->y - shooter->y) > 0) + ((target->y - shooter->y) < 0);
             int cx = target->x + adj_x;
             int cy = target->y + adj_y;
-            if (cx >= 0 && cx < game.consts.map.width && cy >= 0 && cy < game.consts.map.height) {
-                int tile = game.consts.map.map[cy][cx].type;
-                if (tile == 1) cover_modifier = 0.5f;
-                else if (tile == 2) cover_modifier = 0.25f;
-            }
+            if (BB_TEST(&game.consts.map.low_cover, cx, cy)) cover_modifier = 0.5f;
+            else if (BB_TEST(&game.consts.map.high_cover, cx, cy)) cover_modifier = 0.25f;
 
             float damage = shooter_info->soaking_power * range_modifier * cover_modifier;
             if (damage > 0) target->wetness += (int)damage;
@@ -825,18 +1085,14 @@ void simulate_players_commands(int my_cmd_index, int en_cmd_index, SimulationCon
 
         ctx->wetness_gain += (pid == my_id_player) ? -delta : +delta;
     }
-    ctx->control_score = 0;
-    // for (int aid = my_start; aid <= my_stop; aid++) {
-    //     if (!ctx->sim_agents[aid].alive) continue;
-    //     ctx->control_score += controlled_score_gain_if_agent_moves_to(aid, ctx->sim_agents[aid].x, ctx->sim_agents[aid].y);
-    // }
+    ctx->control_score = joint_territory_balance(ctx->sim_agents);
  
     float score_sum = 0.0f;
     int count = 0;
 
     for (int aid = my_start; aid <= my_stop; aid++) {
         if (!ctx->sim_agents[aid].alive) continue;
-        AgentCommand* cmd = &game.output.player_commands[my_id][my_cmd_index][aid];
+        AgentCommand* cmd = PLAYER_COMMAND(my_id, my_cmd_index, aid);
         score_sum += cmd->score;
         count++;
     }
@@ -845,58 +1101,598 @@ void simulate_players_commands(int my_cmd_index, int en_cmd_index, SimulationCon
 
 }
 
-float evaluate_simulation(const SimulationContext* ctx) {
-    
-    
-    return
-        ctx->control_score / 100.0f  * 20.0f +
-        ctx->wetness_gain / 100.0f   * 1.0f +
-        ctx->nb_50_wet_gain / 10.0f  * 1000.0f +
-        ctx->nb_100_wet_gain / 10.0f * 2000.0f;
+// Summed in hundredths as an int, then one division: the weights are the same, but there is no
+// float expression left for -Ofast to contract differently in the scalar and batched callers.
+static inline float evaluate_terms(int control_score, int wetness_gain, int nb_50_wet_gain, int nb_100_wet_gain) {
+    int hundredths =
+        control_score   * 20 +
+        wetness_gain    * 1 +
+        nb_50_wet_gain  * 10000 +
+        nb_100_wet_gain * 20000;
+    return hundredths / 100.0f;
+}
+
+static inline float evaluate_simulation(const SimulationContext* ctx) {
+    return evaluate_terms(ctx->control_score, ctx->wetness_gain, ctx->nb_50_wet_gain, ctx->nb_100_wet_gain);
+}
+
+// --- Batched simulator ---
+// simulate_players_commands for one of my joint commands against SIM_LANES enemy joint commands at
+// once, structure of arrays: one lane per enemy reply in every vector. Integer-only, so the gains
+// are bit-identical to the scalar path: the float shot damage power * range * cover is exact with
+// range in {1, 0.5} and cover in {1, 0.5, 0.25}, i.e. (power * range_quarters * cover_quarters) >> 4.
+// Vector compares give -1 for true, so masks select with & and count with -=.
+#define SIM_LANES 8
+typedef int LaneInt __attribute__((vector_size(SIM_LANES * sizeof(int))));
+#define LANE_SET(v) ((LaneInt){0} + (v))
+#define LANE_ABS(v) ((((v) ^ ((v) >> 31))) - ((v) >> 31))
+
+typedef struct {
+    LaneInt x[MAX_AGENTS];
+    LaneInt y[MAX_AGENTS];
+    LaneInt wetness[MAX_AGENTS];
+    LaneInt alive[MAX_AGENTS];   // -1 alive, 0 dead, after the turn
+    int wetness_gain[SIM_LANES];
+    int nb_50_wet_gain[SIM_LANES];
+    int nb_100_wet_gain[SIM_LANES];
+    int control_score[SIM_LANES];
+} SimulationBatch;
+
+// --scalar-sim: use simulate_players_commands for every pair instead.
+bool batched_simulation = true;
+
+static inline bool lane_any(const LaneInt* mask) {
+    int any = 0;
+    for (int l = 0; l < SIM_LANES; l++) any |= (*mask)[l];
+    return any != 0;
 }
 
-void compute_evaluation() {
+static inline void simulate_players_commands_batch(int my_cmd_index, const int en_cmd_index[SIM_LANES], SimulationBatch* b) {
     int my_id = game.consts.my_player_id;
     int en_id = !my_id;
-    game.output.simulation_count = 0;
+    int my_start = game.consts.player_info[my_id].agent_start_index;
+    int my_stop  = game.consts.player_info[my_id].agent_stop_index;
+    int en_start = game.consts.player_info[en_id].agent_start_index;
+    int en_stop  = game.consts.player_info[en_id].agent_stop_index;
 
-    int my_count = game.output.player_command_count[my_id];
+    LaneInt action[MAX_AGENTS], target_x_or_id[MAX_AGENTS], target_y[MAX_AGENTS];
+    for (int aid = 0; aid < MAX_AGENTS; aid++) {
+        AgentState* agent = &game.state.agents[aid];
+        b->wetness[aid] = LANE_SET(agent->wetness);
+        b->alive[aid] = LANE_SET(agent->alive ? -1 : 0);
+        b->x[aid] = LANE_SET(agent->x);
+        b->y[aid] = LANE_SET(agent->y);
+        action[aid] = LANE_SET(-1);
+        if (!agent->alive) continue;
+
+        if (aid >= my_start && aid <= my_stop) {
+            AgentCommand* cmd = PLAYER_COMMAND(my_id, my_cmd_index, aid);
+            b->x[aid] = LANE_SET(cmd->mv_x);
+            b->y[aid] = LANE_SET(cmd->mv_y);
+            action[aid] = LANE_SET((int)cmd->action_type);
+            target_x_or_id[aid] = LANE_SET(cmd->target_x_or_id);
+            target_y[aid] = LANE_SET(cmd->target_y);
+        } else if (aid >= en_start && aid <= en_stop) {
+            for (int l = 0; l < SIM_LANES; l++) {
+                AgentCommand* cmd = PLAYER_COMMAND(en_id, en_cmd_index[l], aid);
+                b->x[aid][l] = cmd->mv_x;
+                b->y[aid][l] = cmd->mv_y;
+                action[aid][l] = cmd->action_type;
+                target_x_or_id[aid][l] = cmd->target_x_or_id;
+                target_y[aid][l] = cmd->target_y;
+            }
+        }
+    }
+
+    for (int aid = 0; aid < MAX_AGENTS; aid++) {
+        if (!game.state.agents[aid].alive) continue;
+
+        LaneInt throws = action[aid] == CMD_THROW;
+        if (lane_any(&throws)) {
+            for (int t = 0; t < MAX_AGENTS; t++) {
+                if (!game.state.agents[t].alive) continue;
+                LaneInt dx = b->x[t] - target_x_or_id[aid];
+                LaneInt dy = b->y[t] - target_y[aid];
+                LaneInt hit = throws & (LANE_ABS(dx) <= 1) & (LANE_ABS(dy) <= 1);
+                b->wetness[t] += hit & 30;
+            }
+        }
+
+        LaneInt shoots = action[aid] == CMD_SHOOT;
+        if (!lane_any(&shoots)) continue;
+        AgentInfo* shooter_info = &game.consts.agent_info[aid];
+        for (int t = 0; t < MAX_AGENTS; t++) {
+            if (!game.state.agents[t].alive) continue;
+            LaneInt hit = shoots & (target_x_or_id[aid] == t);
+            if (!lane_any(&hit)) continue;
+
+            LaneInt dx = b->x[t] - b->x[aid];
+            LaneInt dy = b->y[t] - b->y[aid];
+            LaneInt dist = LANE_ABS(dx) + LANE_ABS(dy);
+            LaneInt in_optimal = dist <= shooter_info->optimal_range;
+            LaneInt in_range = dist <= 2 * shooter_info->optimal_range;
+            LaneInt range_quarters = (in_optimal & 4) | (~in_optimal & in_range & 2);
+
+            // the tile next to the target on the shooter's side
+            LaneInt cx = b->x[t] + (dx > 0) - (dx < 0);
+            LaneInt cy = b->y[t] + (dy > 0) - (dy < 0);
+            LaneInt cover_quarters;
+            for (int l = 0; l < SIM_LANES; l++) {
+                bool inside = cx[l] >= 0 && cx[l] < game.consts.map.width && cy[l] >= 0 && cy[l] < game.consts.map.height;
+                cover_quarters[l] = inside ? game.consts.map.cover_quarters[CELL_INDEX(cx[l], cy[l])] : 4;
+            }
+
+            LaneInt damage = (shooter_info->soaking_power * range_quarters * cover_quarters) >> 4;
+            b->wetness[t] += hit & damage;
+        }
+    }
+
+    LaneInt wetness_gain = LANE_SET(0), nb_50 = LANE_SET(0), nb_100 = LANE_SET(0);
+    for (int aid = 0; aid < MAX_AGENTS; aid++) {
+        int curr = game.state.agents[aid].wetness;
+        LaneInt now = b->wetness[aid];
+        LaneInt soaked = now >= 100;
+        b->alive[aid] &= ~soaked;
+        now = (soaked & 100) | (~soaked & now);
+
+        int sign = (game.consts.agent_info[aid].player_id == my_id) ? -1 : 1;
+        nb_100 -= (soaked & LANE_SET(curr < 100 ? -1 : 0)) * sign;
+        nb_50 -= ((now >= 50) & LANE_SET(curr < 50 ? -1 : 0)) * sign;
+        wetness_gain += (now - curr) * sign;
+    }
+
+    // joint_territory_balance, with my deltas shared by the lanes
+    int deltas[MAX_AGENTS];
+    for (int aid = my_start; aid <= my_stop; aid++) {
+        AgentState* agent = &game.state.agents[aid];
+        if (!agent->alive) continue;
+        AgentCommand* cmd = PLAYER_COMMAND(my_id, my_cmd_index, aid);
+        bool moved = cmd->mv_x != agent->x || cmd->mv_y != agent->y;
+        deltas[aid] = moved ? territory_delta(aid, cmd->mv_x, cmd->mv_y) : 0;
+    }
+    for (int l = 0; l < SIM_LANES; l++) {
+        b->wetness_gain[l] = wetness_gain[l];
+        b->nb_50_wet_gain[l] = nb_50[l];
+        b->nb_100_wet_gain[l] = nb_100[l];
+
+        // same order of operations as simulate_players_commands
+        int control_score = game.output.territory.score;
+        float score_sum = 0.0f;
+        for (int aid = my_start; aid <= my_stop; aid++) {
+            if (!b->alive[aid][l]) continue;
+            control_score += deltas[aid];
+        }
+        for (int aid = en_start; aid <= en_stop; aid++) {
+            AgentState* agent = &game.state.agents[aid];
+            if (!b->alive[aid][l] || (b->x[aid][l] == agent->x && b->y[aid][l] == agent->y)) continue;
+            control_score += territory_delta(aid, b->x[aid][l], b->y[aid][l]);
+        }
+        for (int aid = my_start; aid <= my_stop; aid++) {
+            if (!b->alive[aid][l]) continue;
+            score_sum += PLAYER_COMMAND(my_id, my_cmd_index, aid)->score;
+        }
+        control_score += score_sum / 100.0;
+        b->control_score[l] = control_score;
+    }
+}
+
+// Best rows first; equal scores keep the lower row, like the selection sort this replaced.
+static inline bool result_before(const SimulationResult* a, const SimulationResult* b) {
+    return a->score > b->score || (a->score == b->score && a->my_cmds_index < b->my_cmds_index);
+}
+
+// A thread's share of compute_evaluation: its rows' worst replies and their top TOP_RESULTS.
+typedef struct {
+    SimulationResult top[TOP_RESULTS];
+    int top_count;
+    long long simulations;
+    long long pruned_simulations;
+    bool aborted;
+    int killers[KILLER_REPLIES];
+    int killer_count;
+} EvaluationPart;
+
+EvaluationPart evaluation_parts[MAX_THREADS];
+
+// Alpha pruning of the max-min (--no-prune to evaluate the full matrix): a row is abandoned as soon
+// as one enemy reply brings it down to the exact_top_count-th best worst case already found in the
+// partition, exact_top_count being compute_evaluation's argument. The abandoned row cannot be among
+// the best exact_top_count, since equal scores keep the earlier row, so that many rows at the front
+// of simulation_results are the same as without pruning, whatever the thread count.
+bool prune_evaluation = true;
+// Enemy joint commands by decreasing total AgentCommand.score, the likely refutations first.
+int enemy_order[MAX_COMMANDS];
+float enemy_order_score[MAX_COMMANDS];
+
+static int compare_enemy_order(const void* a, const void* b) {
+    int ja = *(const int*)a, jb = *(const int*)b;
+    if (enemy_order_score[ja] != enemy_order_score[jb]) return enemy_order_score[ja] > enemy_order_score[jb] ? -1 : 1;
+    return ja - jb;
+}
+
+void order_enemy_replies() {
+    int en_id = !game.consts.my_player_id;
+    int en_start = game.consts.player_info[en_id].agent_start_index;
+    int en_stop  = game.consts.player_info[en_id].agent_stop_index;
     int en_count = game.output.player_command_count[en_id];
+    for (int j = 0; j < en_count; j++) {
+        enemy_order[j] = j;
+        enemy_order_score[j] = 0.0f;
+        for (int a = en_start; a <= en_stop; a++) {
+            if (!game.state.agents[a].alive) continue;
+            enemy_order_score[j] += PLAYER_COMMAND(en_id, j, a)->score;
+        }
+    }
+    qsort(enemy_order, en_count, sizeof(int), compare_enemy_order);
+}
 
-    for (int i = 0; i < my_count; i++) {
+static inline bool is_killer(const EvaluationPart* part, int j) {
+    for (int k = 0; k < part->killer_count; k++) {
+        if (part->killers[k] == j) return true;
+    }
+    return false;
+}
+
+static inline void add_killer(EvaluationPart* part, int j) {
+    int k = 0;
+    while (k < part->killer_count && part->killers[k] != j) k++;
+    if (k == part->killer_count && part->killer_count < KILLER_REPLIES) part->killer_count++;
+    if (k == KILLER_REPLIES) k--;
+    for (; k > 0; k--) part->killers[k] = part->killers[k - 1];
+    part->killers[0] = j;
+}
+
+static inline void insert_top(EvaluationPart* part, const SimulationResult* result) {
+    if (part->top_count == TOP_RESULTS && !result_before(result, &part->top[TOP_RESULTS - 1])) return;
+    int k = (part->top_count < TOP_RESULTS) ? part->top_count++ : TOP_RESULTS - 1;
+    while (k > 0 && result_before(result, &part->top[k - 1])) {
+        part->top[k] = part->top[k - 1];
+        k--;
+    }
+    part->top[k] = *result;
+}
+
+// Absolute wall_ms() at which the current round of run_anytime_search gives up.
+double search_deadline = 1e300;
+
+// Rows [part * n / parts, (part + 1) * n / parts): each row is written to its own slot of
+// simulation_results, so the outcome does not depend on the thread count.
+MULTIVERSION void evaluate_rows(int part, int parts, const void* arg) {
+    int exact_top_count = *(const int*)arg;
+    int my_id = game.consts.my_player_id;
+    int en_id = !my_id;
+    int my_count = game.output.player_command_count[my_id];
+    int en_count = game.output.player_command_count[en_id];
+    EvaluationPart* out = &evaluation_parts[part];
+    out->top_count = 0;
+    out->simulations = 0;
+    out->pruned_simulations = 0;
+    out->killer_count = 0;
+    out->aborted = false;
+    float alpha = -1e30f;
+
+    SimulationContext ctx;
+    SimulationBatch batch;
+    int sequence[MAX_COMMANDS];
+    for (int i = part * my_count / parts; i < (part + 1) * my_count / parts; i++) {
+        if (wall_ms() > search_deadline) {
+            out->aborted = true;
+            break;
+        }
         float worst_score = 1e9f;
         int worst_enemy_cmd = -1;
+        int tried = 0;
+        bool pruned = false;
 
-        for (int j = 0; j < en_count; j++) {
-            SimulationContext ctx;
-            simulate_players_commands(i, j, &ctx);
-            float score = evaluate_simulation(&ctx);
+        int n = 0;
+        for (int k = 0; k < out->killer_count; k++) sequence[n++] = out->killers[k];
+        for (int k = 0; k < en_count; k++) {
+            if (!is_killer(out, enemy_order[k])) sequence[n++] = enemy_order[k];
+        }
 
-            if (score < worst_score) {
-                worst_score = score;
-                worst_enemy_cmd = j;
+        for (int k = 0; k < n && !pruned; k += SIM_LANES) {
+            int lanes = (n - k < SIM_LANES) ? n - k : SIM_LANES;
+            float scores[SIM_LANES];
+            if (batched_simulation) {
+                int replies[SIM_LANES];
+                for (int l = 0; l < SIM_LANES; l++) replies[l] = sequence[k + (l < lanes ? l : 0)];
+                simulate_players_commands_batch(i, replies, &batch);
+                for (int l = 0; l < lanes; l++) {
+                    scores[l] = evaluate_terms(batch.control_score[l], batch.wetness_gain[l],
+                                               batch.nb_50_wet_gain[l], batch.nb_100_wet_gain[l]);
+                }
+                tried += lanes;
+            }
+            for (int l = 0; l < lanes && !pruned; l++) {
+                int j = sequence[k + l];
+                if (!batched_simulation) {
+                    simulate_players_commands(i, j, &ctx);
+                    scores[l] = evaluate_simulation(&ctx);
+                    tried++;
+                }
+                float score = scores[l];
+
+                if (score < worst_score || (score == worst_score && j < worst_enemy_cmd)) {
+                    worst_score = score;
+                    worst_enemy_cmd = j;
+                }
+                if (prune_evaluation && worst_score <= alpha) pruned = true;
             }
         }
+        out->simulations += tried;
+        out->pruned_simulations += en_count - tried;
 
-        game.output.simulation_results[game.output.simulation_count++] = (SimulationResult){
+        // A pruned row keeps the refuting score, an upper bound of its worst case.
+        game.output.simulation_results[i] = (SimulationResult){
             .score = worst_score,
             .my_cmds_index = i,
             .op_cmds_index = worst_enemy_cmd
         };
+        if (pruned) {
+            add_killer(out, worst_enemy_cmd);
+            continue;
+        }
+        insert_top(out, &game.output.simulation_results[i]);
+        if (out->top_count >= exact_top_count) alpha = out->top[exact_top_count - 1].score;
     }
-    for (int a = 0; a < game.output.simulation_count - 1; a++) {
-        for (int b = a + 1; b < game.output.simulation_count; b++) {
-            if (game.output.simulation_results[b].score > game.output.simulation_results[a].score) {
-                SimulationResult tmp = game.output.simulation_results[a];
-                game.output.simulation_results[a] = game.output.simulation_results[b];
-                game.output.simulation_results[b] = tmp;
-            }
+}
+
+// simulation_results[i] is row i's worst case, then the best TOP_RESULTS rows are merged from the
+// parts and moved to the front in order; the other rows follow in row order. With pruning, the
+// front only holds fully evaluated rows and its first exact_top_count are the same as without.
+void compute_evaluation(int exact_top_count) {
+    double start = wall_ms();
+    int my_count = game.output.player_command_count[game.consts.my_player_id];
+    order_enemy_replies();
+    game.output.territory.frozen = true;
+    pool_run(evaluate_rows, &exact_top_count);
+    game.output.territory.frozen = false;
+    game.output.simulation_count = my_count;
+
+    static SimulationResult merged[MAX_SIMULATIONS];
+    static bool selected[MAX_SIMULATIONS];
+    int heads[MAX_THREADS] = {0};
+    int top_count = 0;
+    game.output.simulations = 0;
+    game.output.pruned_simulations = 0;
+    game.output.evaluation_aborted = false;
+    for (int p = 0; p < pool.thread_count; p++) {
+        game.output.simulations += evaluation_parts[p].simulations;
+        game.output.pruned_simulations += evaluation_parts[p].pruned_simulations;
+        game.output.evaluation_aborted |= evaluation_parts[p].aborted;
+    }
+
+    while (top_count < TOP_RESULTS) {
+        int best = -1;
+        for (int p = 0; p < pool.thread_count; p++) {
+            if (heads[p] == evaluation_parts[p].top_count) continue;
+            if (best < 0 || result_before(&evaluation_parts[p].top[heads[p]], &evaluation_parts[best].top[heads[best]]))
+                best = p;
+        }
+        if (best < 0) break;
+        merged[top_count++] = evaluation_parts[best].top[heads[best]++];
+    }
+
+    memset(selected, 0, my_count * sizeof(bool));
+    for (int k = 0; k < top_count; k++) selected[merged[k].my_cmds_index] = true;
+    int n = top_count;
+    for (int i = 0; i < my_count; i++) {
+        if (!selected[i]) merged[n++] = game.output.simulation_results[i];
+    }
+    memcpy(game.output.simulation_results, merged, my_count * sizeof(SimulationResult));
+    game.output.sorted_count = (prune_evaluation && top_count > exact_top_count) ? exact_top_count : top_count;
+    game.output.turn_simulations += game.output.simulations;
+    game.output.evaluation_ms = wall_ms() - start;
+}
+
+
+
+
+// --- Anytime search ---
+// Rounds of compute_best_player_commands + compute_evaluation with command sets growing from
+// FIRST_ROUND_COMMANDS to MAX_COMMANDS_PLAYER_* joint commands per player. Every complete round
+// replaces best_commands, an aborted one is dropped, so an answer is always ready when the
+// per-turn deadline (--deadline MS, --first-deadline MS, from the end of the turn input) comes.
+#define FIRST_ROUND_COMMANDS 8
+#define ROUND_GROWTH 4   // a round with twice the commands per player costs about 4x
+
+double turn_deadline_ms = 40.0;
+double first_turn_deadline_ms = 900.0;
+
+// Before any round: every agent plays its best-scored move and action. Collisions are possible;
+// the first round replaces it unless the deadline is already gone.
+void seed_best_commands() {
+    for (int a = 0; a < MAX_AGENTS; a++) {
+        if (game.output.agent_command_counts[a] > 0) {
+            game.output.best_commands[a] = game.output.agent_commands[a][0];
+        } else {
+            game.output.best_commands[a] = (AgentCommand){
+                .mv_x = game.state.agents[a].x,
+                .mv_y = game.state.agents[a].y,
+                .action_type = CMD_HUNKER,
+                .target_x_or_id = -1,
+                .target_y = -1
+            };
+        }
+    }
+    game.output.best_score = -1e9f;
+    game.output.search_rounds = 0;
+}
+
+// exact_top_count: rows of every round that must be the true best, for run_beam_search.
+void run_anytime_search(int exact_top_count) {
+    int my_id = game.consts.my_player_id;
+    double budget = (turn_count == 1) ? first_turn_deadline_ms : turn_deadline_ms;
+    search_deadline = gCPUStart + budget;
+    seed_best_commands();
+    game.output.turn_simulations = 0;
+
+    double last_round_ms = 0.0;
+    for (int limit = FIRST_ROUND_COMMANDS; ; limit *= 2) {
+        if (game.output.search_rounds > 0 && CPU_MS_USED + ROUND_GROWTH * last_round_ms > budget) break;
+
+        double start = wall_ms();
+        int my_limit = (limit < MAX_COMMANDS_PLAYER_ME) ? limit : MAX_COMMANDS_PLAYER_ME;
+        int en_limit = (limit < MAX_COMMANDS_PLAYER_ENEMIE) ? limit : MAX_COMMANDS_PLAYER_ENEMIE;
+        game.output.player_command_limit[my_id] = my_limit;
+        game.output.player_command_limit[!my_id] = en_limit;
+        compute_best_player_commands();
+        compute_evaluation(exact_top_count);
+        if (game.output.evaluation_aborted) break;
+
+        if (game.output.simulation_count > 0) {
+            int best_index = game.output.simulation_results[0].my_cmds_index;
+            gather_player_command(my_id, best_index, game.output.best_commands);
+            game.output.best_score = game.output.simulation_results[0].score;
         }
+        game.output.search_rounds++;
+        last_round_ms = wall_ms() - start;
+        if (my_limit == MAX_COMMANDS_PLAYER_ME && en_limit == MAX_COMMANDS_PLAYER_ENEMIE) break;
     }
 }
 
+// --- Beam search ---
+// Looks beam_depth turns ahead (--beam-depth N, 1 = one-turn search only). The first turn comes
+// from the anytime search's last round: its best rows, each played against its refuting enemy
+// reply, are the beam. Every later turn reruns compute_territory, compute_best_agents_commands
+// and a BEAM_COMMANDS round of compute_evaluation from the node's state, and keeps the best
+// MAX_BEAM_WIDTH nodes by discounted sum of worst-case turn scores. Nodes live in beam_pool,
+// reset every turn. A depth the deadline cuts is dropped, as an aborted round is.
+#define MAX_BEAM_DEPTH 4
+#define MAX_BEAM_WIDTH 8
+#define BEAM_CHILDREN 4    // rows kept per expanded node
+#define BEAM_COMMANDS 64   // joint commands per player when expanding a node
+#define BEAM_DISCOUNT 0.5f
+#define MAX_BEAM_NODES (MAX_BEAM_DEPTH * MAX_BEAM_WIDTH * BEAM_CHILDREN)
 
+typedef struct {
+    GameState state;
+    float value;
+    AgentCommand first_commands[MAX_AGENTS];   // my joint command of the first turn
+} BeamNode;
 
+BeamNode beam_pool[MAX_BEAM_NODES];
+int beam_pool_used;
+int beam_depth = 3;
+int beam_depth_reached;
+
+// The state after simulate_players_commands, with the cooldowns and bombs it does not track.
+void advance_game_state(int my_cmd_index, int en_cmd_index, GameState* next) {
+    int my_id = game.consts.my_player_id;
+    int my_start = game.consts.player_info[my_id].agent_start_index;
+    int my_stop  = game.consts.player_info[my_id].agent_stop_index;
+    SimulationContext ctx;
+    simulate_players_commands(my_cmd_index, en_cmd_index, &ctx);
+
+    *next = game.state;
+    memcpy(next->agents, ctx.sim_agents, sizeof(next->agents));
+    memset(next->occupancy, 0, sizeof(next->occupancy));
+    for (int aid = 0; aid < MAX_AGENTS; aid++) {
+        if (!game.state.agents[aid].alive) continue;
+        AgentState* agent = &next->agents[aid];
+        if (agent->alive) BB_SET(&next->occupancy[game.consts.agent_info[aid].player_id], agent->x, agent->y);
+        bool mine = aid >= my_start && aid <= my_stop;
+        AgentCommand* cmd = mine ? PLAYER_COMMAND(my_id, my_cmd_index, aid)
+                                 : PLAYER_COMMAND(!my_id, en_cmd_index, aid);
+        if (agent->wetness > 100) agent->wetness = 100;
+        if (agent->cooldown > 0) agent->cooldown--;
+        if (cmd->action_type == CMD_SHOOT) agent->cooldown = game.consts.agent_info[aid].shoot_cooldown;
+        else if (cmd->action_type == CMD_THROW) agent->splash_bombs--;
+    }
+}
+
+static bool player_alive(const GameState* state, int player_id) {
+    int start = game.consts.player_info[player_id].agent_start_index;
+    int stop  = game.consts.player_info[player_id].agent_stop_index;
+    for (int aid = start; aid <= stop; aid++) {
+        if (state->agents[aid].alive) return true;
+    }
+    return false;
+}
+
+// Children of the position in game.state from the exact rows at the front of simulation_results.
+// parent is NULL at the root, whose children take their own first-turn commands.
+static int add_beam_children(const BeamNode* parent, float weight, BeamNode** children, int count) {
+    int my_id = game.consts.my_player_id;
+    int n = parent ? BEAM_CHILDREN : MAX_BEAM_WIDTH;
+    if (n > game.output.sorted_count) n = game.output.sorted_count;
+    for (int k = 0; k < n && beam_pool_used < MAX_BEAM_NODES; k++) {
+        SimulationResult* result = &game.output.simulation_results[k];
+        if (result->op_cmds_index < 0) break;
+        BeamNode* child = &beam_pool[beam_pool_used++];
+        advance_game_state(result->my_cmds_index, result->op_cmds_index, &child->state);
+        child->value = (parent ? parent->value : 0.0f) + weight * result->score;
+        if (parent) memcpy(child->first_commands, parent->first_commands, sizeof(child->first_commands));
+        else gather_player_command(my_id, result->my_cmds_index, child->first_commands);
+        children[count++] = child;
+    }
+    return count;
+}
+
+void run_beam_search() {
+    int my_id = game.consts.my_player_id;
+    beam_depth_reached = (game.output.search_rounds > 0) ? 1 : 0;
+    if (beam_depth < 2 || game.output.search_rounds == 0 || game.output.evaluation_aborted) return;
+
+    static BeamNode* layer[MAX_BEAM_WIDTH * BEAM_CHILDREN];
+    static BeamNode* next_layer[MAX_BEAM_WIDTH * BEAM_CHILDREN];
+    // Expanding a node reruns the turn pipeline on game, which is put back as it was at the end.
+    static GameOutput root_output;
+    GameState root = game.state;
+    root_output = game.output;
+    beam_pool_used = 0;
+    int layer_count = add_beam_children(NULL, 1.0f, layer, 0);
+    float weight = 1.0f;
+    const BeamNode* best = NULL;
+
+    for (int depth = 2; depth <= beam_depth && depth <= MAX_BEAM_DEPTH; depth++) {
+        weight *= BEAM_DISCOUNT;
+        int next_count = 0;
+        bool aborted = false;
+        for (int n = 0; n < layer_count && !aborted; n++) {
+            BeamNode* node = layer[n];
+            if (wall_ms() > search_deadline) {
+                aborted = true;
+                break;
+            }
+            if (!player_alive(&node->state, my_id) || !player_alive(&node->state, !my_id)) {
+                next_layer[next_count++] = node;   // game over, carried as it is
+                continue;
+            }
+            game.state = node->state;
+            compute_territory();
+            compute_best_agents_commands();
+            game.output.player_command_limit[my_id] = BEAM_COMMANDS;
+            game.output.player_command_limit[!my_id] = BEAM_COMMANDS;
+            compute_best_player_commands();
+            compute_evaluation(BEAM_CHILDREN);
+            aborted = game.output.evaluation_aborted;
+            if (!aborted) next_count = add_beam_children(node, weight, next_layer, next_count);
+        }
+        if (aborted || next_count == 0) break;
+
+        // Keep the best MAX_BEAM_WIDTH, earlier nodes first on ties.
+        layer_count = 0;
+        for (int n = 0; n < next_count; n++) {
+            int k = (layer_count < MAX_BEAM_WIDTH) ? layer_count++ : MAX_BEAM_WIDTH;
+            if (k == MAX_BEAM_WIDTH && next_layer[n]->value <= layer[MAX_BEAM_WIDTH - 1]->value) continue;
+            if (k == MAX_BEAM_WIDTH) k--;
+            while (k > 0 && layer[k - 1]->value < next_layer[n]->value) {
+                layer[k] = layer[k - 1];
+                k--;
+            }
+            layer[k] = next_layer[n];
+        }
+        best = layer[0];
+        beam_depth_reached = depth;
+    }
+
+    long long turn_simulations = game.output.turn_simulations;
+    game.state = root;
+    game.output = root_output;
+    game.output.turn_simulations = turn_simulations;
+    if (best) memcpy(game.output.best_commands, best->first_commands, sizeof(game.output.best_commands));
+}
 
 void apply_output() {
     float cpu = CPU_MS_USED;
@@ -907,12 +1703,9 @@ void apply_output() {
     int enemy_start_id = game.consts.player_info[enemy_player_id].agent_start_index;
     int enemy_stop_id  = game.consts.player_info[enemy_player_id].agent_stop_index;
 
-    if (game.output.simulation_count == 0) {
-        ERROR("no simu result");
-    }
     // fprintf(stderr, "\n=== ENEMY AGENTS (cmd_id = 0) ===\n");
     // for (int enemy_id = enemy_start_id; enemy_id <= enemy_stop_id; enemy_id++) {
-    //     AgentCommand *e_cmd = &game.output.player_commands[enemy_player_id][0][enemy_id];
+    //     AgentCommand *e_cmd = PLAYER_COMMAND(enemy_player_id, 0, enemy_id);
     //     const char *e_act = (e_cmd->action_type == CMD_SHOOT) ? "SH" :
     //                         (e_cmd->action_type == CMD_THROW) ? "TH" : "HK";
     //     fprintf(stderr, "E%d:(%d,%d)%s(%d,%d)[%.1f]\n",
@@ -926,7 +1719,7 @@ void apply_output() {
     //         rank + 1, res->score, res->my_cmds_index, res->op_cmds_index);
 
     //     for (int agent_id = agent_start_id; agent_id <= agent_stop_id; agent_id++) {
-    //         AgentCommand *cmd = &game.output.player_commands[my_player_id][res->my_cmds_index][agent_id];
+    //         AgentCommand *cmd = PLAYER_COMMAND(my_player_id, res->my_cmds_index, agent_id);
     //         const char *act = (cmd->action_type == CMD_SHOOT) ? "SH" :
     //                           (cmd->action_type == CMD_THROW) ? "TH" : "HK";
     //         fprintf(stderr, "A%d:(%d,%d)%s(%d,%d)[%.1f] ",
@@ -938,12 +1731,9 @@ void apply_output() {
     // }
     // fprintf(stderr, "================\n");
 
-    int best_index = game.output.simulation_results[0].my_cmds_index;
-
-
     for (int agent_id = agent_start_id; agent_id <= agent_stop_id; agent_id++) {
         if(!game.state.agents[agent_id].alive) continue;
-        AgentCommand* cmd = &game.output.player_commands[my_player_id][best_index][agent_id];
+        AgentCommand* cmd = &game.output.best_commands[agent_id];
 
         printf("%d", agent_id+1);
 
@@ -959,22 +1749,35 @@ void apply_output() {
         } else {
         }
 
-        printf(";MESSAGE %.2fms",cpu);
+        printf(";MESSAGE %.2fms r%d d%d s%lld",cpu,game.output.search_rounds,beam_depth_reached,game.output.turn_simulations);
 
         printf("\n");
         fflush(stdout);
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // --threads N: split compute_evaluation's rows across N threads (default 1).
+    // --no-prune: evaluate every enemy reply of every row.
+    // --scalar-sim: one simulate_players_commands call per pair instead of SIM_LANES replies at once.
+    // --deadline MS, --first-deadline MS: per-turn budget of the anytime search (40 ms, 900 ms).
+    // --beam-depth N: turns the beam search looks ahead within that budget (default 3, 1 = off).
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--threads") && a + 1 < argc) pool_start(atoi(argv[++a]));
+        else if (!strcmp(argv[a], "--no-prune")) prune_evaluation = false;
+        else if (!strcmp(argv[a], "--scalar-sim")) batched_simulation = false;
+        else if (!strcmp(argv[a], "--deadline") && a + 1 < argc) turn_deadline_ms = atof(argv[++a]);
+        else if (!strcmp(argv[a], "--first-deadline") && a + 1 < argc) first_turn_deadline_ms = atof(argv[++a]);
+        else if (!strcmp(argv[a], "--beam-depth") && a + 1 < argc) beam_depth = atoi(argv[++a]);
+    }
     read_game_inputs_init();
 
     while (1) {
         read_game_inputs_cycle();
-        precompute_bfs_distances();
+        compute_territory();
         compute_best_agents_commands();
-        compute_best_player_commands();
-        compute_evaluation();
+        run_anytime_search(beam_depth > 1 ? MAX_BEAM_WIDTH : 1);
+        run_beam_search();
         apply_output();
         // debug_stats();
 
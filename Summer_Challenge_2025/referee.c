@@ -0,0 +1,704 @@
+// Local referee for Soak Overflow (rules in soak_overflow.pdf) and a self-play arena: plays seeded
+// matches between two bot programs over pipes, several matches at once, and reports the win rate,
+// the response time of every turn and the simulations per turn a bot prints in its MESSAGE as
+// " s<count>" (main.c does).
+//
+//   gcc -O2 -Wall -pthread -o referee referee.c -lm
+//   ./referee --bot-a "./main --beam-depth 3" --bot-b "./main --beam-depth 1" --matches 1000 --jobs 8 --seed 1
+//
+// --timeout MS: a bot answering later than MS (20x that on the first turn, as 1000 ms vs 50 ms on
+// the judge) loses the match. 0, the default, only measures. Match i is played on the map of
+// seed + i / 2 with the sides swapped for odd i, so both bots get every map from both sides.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <math.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define MAX_WIDTH  20
+#define MAX_HEIGHT 10
+#define MAX_AGENTS 10
+#define MAX_PLAYERS 2
+#define MAX_TURNS 100
+#define WIN_MARGIN 600
+#define BOMB_RANGE 4
+#define BOMB_WETNESS 30
+#define HUNKER_PROTECTION 0.25
+#define MAX_ARGS 32
+#define LINE_SIZE 1024
+#define UNREACHABLE 9999
+
+#define ERROR(text) {fprintf(stderr,"ERROR:%s\n",text);fflush(stderr);exit(1);}
+
+static double wall_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// --- Game ---
+typedef struct {
+    int shoot_cooldown;
+    int optimal_range;
+    int soaking_power;
+    int splash_bombs;
+} AgentClass;
+
+// gunner, sniper, bomber, assault, berserker
+static const AgentClass agent_classes[] = {
+    {1, 4, 16, 1},
+    {5, 6, 24, 0},
+    {2, 2, 8, 3},
+    {2, 4, 16, 2},
+    {5, 2, 32, 1},
+};
+#define AGENT_CLASS_COUNT ((int)(sizeof(agent_classes) / sizeof(agent_classes[0])))
+
+typedef enum {
+    ACTION_NONE,
+    ACTION_SHOOT,
+    ACTION_THROW,
+    ACTION_HUNKER
+} ActionType;
+
+typedef struct {
+    int player;
+    AgentClass info;
+    int x, y;
+    int cooldown;
+    int splash_bombs;
+    int wetness;
+    bool alive;
+    // command of the current turn
+    bool commanded;
+    bool moving;
+    int move_x, move_y;
+    ActionType action;
+    int target_x_or_id, target_y;
+} Agent;
+
+typedef struct {
+    int width, height;
+    int tiles[MAX_HEIGHT][MAX_WIDTH];
+    Agent agents[MAX_AGENTS];
+    int agent_count;
+    int score[MAX_PLAYERS];
+    unsigned long long rng;
+} Match;
+
+static unsigned long long next_random(Match* m) {
+    unsigned long long z = (m->rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int random_below(Match* m, int n) {
+    return (int)(next_random(m) % (unsigned long long)n);
+}
+
+static bool inside(const Match* m, int x, int y) {
+    return x >= 0 && x < m->width && y >= 0 && y < m->height;
+}
+
+static bool is_free(const Match* m, int x, int y) {
+    return inside(m, x, y) && m->tiles[y][x] == 0;
+}
+
+// Mirror-symmetric map: covers on the left half and their mirror, player 0 spawning in the two
+// left columns and player 1 on the mirrored cells, agent k of both players of the same class.
+void generate_match(Match* m, unsigned long long seed) {
+    memset(m, 0, sizeof(*m));
+    m->rng = seed;
+    m->width = 12 + random_below(m, MAX_WIDTH - 12 + 1);
+    m->height = 6 + random_below(m, MAX_HEIGHT - 6 + 1);
+    for (int y = 0; y < m->height; y++) {
+        for (int x = 0; x < m->width / 2; x++) {
+            if (random_below(m, 8) != 0) continue;
+            int tile = 1 + random_below(m, 2);
+            m->tiles[y][x] = tile;
+            m->tiles[y][m->width - 1 - x] = tile;
+        }
+    }
+
+    int per_player = 3 + random_below(m, MAX_AGENTS / 2 - 3 + 1);
+    bool taken[MAX_HEIGHT][2] = {{false}};
+    for (int k = 0; k < per_player; k++) {
+        int x, y;
+        do {
+            x = random_below(m, 2);
+            y = random_below(m, m->height);
+        } while (taken[y][x]);
+        taken[y][x] = true;
+        m->tiles[y][x] = 0;
+        m->tiles[y][m->width - 1 - x] = 0;
+
+        AgentClass info = agent_classes[random_below(m, AGENT_CLASS_COUNT)];
+        for (int p = 0; p < MAX_PLAYERS; p++) {
+            Agent* agent = &m->agents[p * per_player + k];
+            agent->player = p;
+            agent->info = info;
+            agent->x = p ? m->width - 1 - x : x;
+            agent->y = y;
+            agent->splash_bombs = info.splash_bombs;
+            agent->alive = true;
+        }
+    }
+    m->agent_count = 2 * per_player;
+}
+
+static int alive_agents(const Match* m, int player) {
+    int count = 0;
+    for (int a = 0; a < m->agent_count; a++) {
+        if (m->agents[a].alive && m->agents[a].player == player) count++;
+    }
+    return count;
+}
+
+// First step from (x, y) on a shortest path of free tiles to the target, which may itself be a
+// cover: the move is then cancelled on arrival like any move onto a cover.
+static void next_step(const Match* m, int x, int y, int target_x, int target_y, int* step_x, int* step_y) {
+    static const int dirs[4][2] = {{0,-1},{1,0},{0,1},{-1,0}};
+    *step_x = x;
+    *step_y = y;
+    if (abs(target_x - x) + abs(target_y - y) == 1) {
+        *step_x = target_x;
+        *step_y = target_y;
+        return;
+    }
+
+    int dist[MAX_HEIGHT][MAX_WIDTH];
+    int queue[MAX_HEIGHT * MAX_WIDTH];
+    for (int j = 0; j < m->height; j++) {
+        for (int i = 0; i < m->width; i++) dist[j][i] = UNREACHABLE;
+    }
+    int front = 0, back = 0;
+    dist[target_y][target_x] = 0;
+    queue[back++] = target_y * MAX_WIDTH + target_x;
+    while (front < back) {
+        int cx = queue[front] % MAX_WIDTH, cy = queue[front] / MAX_WIDTH;
+        front++;
+        for (int d = 0; d < 4; d++) {
+            int nx = cx + dirs[d][0], ny = cy + dirs[d][1];
+            if (!is_free(m, nx, ny) || dist[ny][nx] != UNREACHABLE) continue;
+            dist[ny][nx] = dist[cy][cx] + 1;
+            queue[back++] = ny * MAX_WIDTH + nx;
+        }
+    }
+
+    int best = dist[y][x];
+    for (int d = 0; d < 4; d++) {
+        int nx = x + dirs[d][0], ny = y + dirs[d][1];
+        if (!is_free(m, nx, ny) || dist[ny][nx] >= best) continue;
+        best = dist[ny][nx];
+        *step_x = nx;
+        *step_y = ny;
+    }
+}
+
+// Highest protection of a cover orthogonally next to the target on the side the shot comes
+// from. A cover the shooter is next to as well does not count.
+static double cover_protection(const Match* m, const Agent* shooter, const Agent* target) {
+    double best = 0.0;
+    int dx = shooter->x - target->x;
+    int dy = shooter->y - target->y;
+    int covers[2][2] = {{target->x + (dx > 0) - (dx < 0), target->y},
+                        {target->x, target->y + (dy > 0) - (dy < 0)}};
+    bool crossed[2] = {abs(dx) > 1, abs(dy) > 1};
+    for (int c = 0; c < 2; c++) {
+        int cx = covers[c][0], cy = covers[c][1];
+        if (!crossed[c] || !inside(m, cx, cy) || m->tiles[cy][cx] == 0) continue;
+        if (abs(shooter->x - cx) <= 1 && abs(shooter->y - cy) <= 1) continue;
+        double protection = (m->tiles[cy][cx] == 1) ? 0.5 : 0.75;
+        if (protection > best) best = protection;
+    }
+    return best;
+}
+
+// MOVE, then HUNKER_DOWN, then SHOOT and THROW all at once, then the soaked agents leave and the
+// territory is scored.
+void resolve_turn(Match* m) {
+    int dest_x[MAX_AGENTS], dest_y[MAX_AGENTS];
+    for (int a = 0; a < m->agent_count; a++) {
+        Agent* agent = &m->agents[a];
+        dest_x[a] = agent->x;
+        dest_y[a] = agent->y;
+        if (agent->alive && agent->moving) next_step(m, agent->x, agent->y, agent->move_x, agent->move_y, &dest_x[a], &dest_y[a]);
+    }
+    // A cancelled move can block another one, so until nothing changes.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int a = 0; a < m->agent_count; a++) {
+            Agent* agent = &m->agents[a];
+            if (!agent->alive || (dest_x[a] == agent->x && dest_y[a] == agent->y)) continue;
+            bool cancel = !is_free(m, dest_x[a], dest_y[a]);
+            for (int b = 0; b < m->agent_count && !cancel; b++) {
+                Agent* other = &m->agents[b];
+                if (b == a || !other->alive) continue;
+                if (dest_x[b] == dest_x[a] && dest_y[b] == dest_y[a]) cancel = true;
+                if (dest_x[b] == agent->x && dest_y[b] == agent->y && dest_x[a] == other->x && dest_y[a] == other->y)
+                    cancel = true;
+            }
+            if (cancel) {
+                dest_x[a] = agent->x;
+                dest_y[a] = agent->y;
+                changed = true;
+            }
+        }
+    }
+    for (int a = 0; a < m->agent_count; a++) {
+        m->agents[a].x = dest_x[a];
+        m->agents[a].y = dest_y[a];
+    }
+
+    int wetness_gain[MAX_AGENTS] = {0};
+    for (int a = 0; a < m->agent_count; a++) {
+        Agent* agent = &m->agents[a];
+        if (!agent->alive) continue;
+        if (agent->action == ACTION_SHOOT) {
+            if (agent->cooldown > 0) continue;
+            Agent* target = &m->agents[agent->target_x_or_id];
+            if (!target->alive || target->player == agent->player) continue;
+            int dist = abs(agent->x - target->x) + abs(agent->y - target->y);
+            double range = (dist <= agent->info.optimal_range) ? 1.0 :
+                           (dist <= 2 * agent->info.optimal_range) ? 0.5 : 0.0;
+            double protection = cover_protection(m, agent, target);
+            if (target->action == ACTION_HUNKER) protection += HUNKER_PROTECTION;
+            if (protection > 1.0) protection = 1.0;
+            wetness_gain[agent->target_x_or_id] += (int)round(agent->info.soaking_power * range * (1.0 - protection));
+        } else if (agent->action == ACTION_THROW) {
+            if (agent->splash_bombs <= 0) continue;
+            if (abs(agent->x - agent->target_x_or_id) + abs(agent->y - agent->target_y) > BOMB_RANGE) continue;
+            agent->splash_bombs--;
+            for (int t = 0; t < m->agent_count; t++) {
+                Agent* target = &m->agents[t];
+                if (target->alive && abs(target->x - agent->target_x_or_id) <= 1 && abs(target->y - agent->target_y) <= 1)
+                    wetness_gain[t] += BOMB_WETNESS;
+            }
+        }
+    }
+
+    for (int a = 0; a < m->agent_count; a++) {
+        Agent* agent = &m->agents[a];
+        if (!agent->alive) continue;
+        bool shot = agent->action == ACTION_SHOOT && agent->cooldown == 0;
+        if (agent->cooldown > 0) agent->cooldown--;
+        if (shot) agent->cooldown = agent->info.shoot_cooldown;
+        agent->wetness += wetness_gain[a];
+        if (agent->wetness >= 100) {
+            agent->wetness = 100;
+            agent->alive = false;
+        }
+    }
+
+    // A tile belongs to the player with the nearest agent, distances doubled at wetness >= 50.
+    int controlled[MAX_PLAYERS] = {0};
+    for (int y = 0; y < m->height; y++) {
+        for (int x = 0; x < m->width; x++) {
+            if (m->tiles[y][x] != 0) continue;
+            int best[MAX_PLAYERS] = {INT_MAX, INT_MAX};
+            for (int a = 0; a < m->agent_count; a++) {
+                Agent* agent = &m->agents[a];
+                if (!agent->alive) continue;
+                int d = abs(agent->x - x) + abs(agent->y - y);
+                if (agent->wetness >= 50) d *= 2;
+                if (d < best[agent->player]) best[agent->player] = d;
+            }
+            if (best[0] < best[1]) controlled[0]++;
+            else if (best[1] < best[0]) controlled[1]++;
+        }
+    }
+    if (controlled[0] > controlled[1]) m->score[0] += controlled[0] - controlled[1];
+    if (controlled[1] > controlled[0]) m->score[1] += controlled[1] - controlled[0];
+}
+
+// --- Bot processes ---
+typedef struct {
+    pid_t pid;
+    int to_bot, from_bot;
+    char buffer[LINE_SIZE * 16];
+    int start, end;
+} BotProcess;
+
+void start_bot(BotProcess* bot, const char* command) {
+    char words[LINE_SIZE];
+    char* argv[MAX_ARGS + 1];
+    int argc = 0;
+    snprintf(words, sizeof(words), "%s", command);
+    for (char* save = NULL, *word = strtok_r(words, " ", &save); word && argc < MAX_ARGS; word = strtok_r(NULL, " ", &save))
+        argv[argc++] = word;
+    argv[argc] = NULL;
+    if (argc == 0) ERROR("empty bot command")
+
+    int input[2], output[2];
+    if (pipe2(input, O_CLOEXEC) || pipe2(output, O_CLOEXEC)) ERROR("pipe")
+    bot->pid = fork();
+    if (bot->pid < 0) ERROR("fork")
+    if (bot->pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(input[0], 0);
+        dup2(output[1], 1);
+        if (null >= 0) dup2(null, 2);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+    bot->to_bot = input[1];
+    bot->from_bot = output[0];
+    bot->start = bot->end = 0;
+}
+
+void stop_bot(BotProcess* bot) {
+    kill(bot->pid, SIGKILL);
+    waitpid(bot->pid, NULL, 0);
+    close(bot->to_bot);
+    close(bot->from_bot);
+}
+
+static bool send_to_bot(BotProcess* bot, const char* text, int length) {
+    while (length > 0) {
+        ssize_t n = write(bot->to_bot, text, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        text += n;
+        length -= n;
+    }
+    return true;
+}
+
+// One line without its newline; false on end of file, error, or when deadline (absolute
+// wall_ms(), 0 for none) passes first.
+static bool read_bot_line(BotProcess* bot, char* line, double deadline) {
+    while (1) {
+        char* newline = memchr(bot->buffer + bot->start, '\n', bot->end - bot->start);
+        if (newline) {
+            int length = newline - (bot->buffer + bot->start);
+            if (length >= LINE_SIZE) length = LINE_SIZE - 1;
+            memcpy(line, bot->buffer + bot->start, length);
+            line[length] = '\0';
+            bot->start = newline + 1 - bot->buffer;
+            return true;
+        }
+        if (bot->start > 0) {
+            memmove(bot->buffer, bot->buffer + bot->start, bot->end - bot->start);
+            bot->end -= bot->start;
+            bot->start = 0;
+        }
+        if (bot->end == (int)sizeof(bot->buffer)) return false;
+
+        if (deadline > 0) {
+            double left = deadline - wall_ms();
+            if (left <= 0) return false;
+            struct pollfd ready = {.fd = bot->from_bot, .events = POLLIN};
+            int n = poll(&ready, 1, (int)ceil(left));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+        }
+        ssize_t n = read(bot->from_bot, bot->buffer + bot->end, sizeof(bot->buffer) - bot->end);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bot->end += n;
+    }
+}
+
+// --- Protocol ---
+static int write_init_input(const Match* m, int player, char* text) {
+    int n = sprintf(text, "%d\n%d\n", player, m->agent_count);
+    for (int a = 0; a < m->agent_count; a++) {
+        const Agent* agent = &m->agents[a];
+        n += sprintf(text + n, "%d %d %d %d %d %d\n", a + 1, agent->player, agent->info.shoot_cooldown,
+                     agent->info.optimal_range, agent->info.soaking_power, agent->info.splash_bombs);
+    }
+    n += sprintf(text + n, "%d %d\n", m->width, m->height);
+    for (int y = 0; y < m->height; y++) {
+        for (int x = 0; x < m->width; x++) n += sprintf(text + n, "%d %d %d\n", x, y, m->tiles[y][x]);
+    }
+    return n;
+}
+
+static int write_turn_input(const Match* m, int player, char* text) {
+    int alive = alive_agents(m, 0) + alive_agents(m, 1);
+    int n = sprintf(text, "%d\n", alive);
+    for (int a = 0; a < m->agent_count; a++) {
+        const Agent* agent = &m->agents[a];
+        if (!agent->alive) continue;
+        n += sprintf(text + n, "%d %d %d %d %d %d\n", a + 1, agent->x, agent->y, agent->cooldown,
+                     agent->splash_bombs, agent->wetness);
+    }
+    n += sprintf(text + n, "%d\n", alive_agents(m, player));
+    return n;
+}
+
+static char* trim(char* text) {
+    while (isspace((unsigned char)*text)) text++;
+    char* end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) *--end = '\0';
+    return text;
+}
+
+// "[id;]MOVE x y;SHOOT id|THROW x y|HUNKER_DOWN;MESSAGE text" into the agent's command; without
+// an id the line goes to the next agent of the player in id order (*next_agent). The " s<count>"
+// word of the message, if any, goes to *simulations. false for an invalid command.
+static bool parse_command(Match* m, int player, char* line, int* next_agent, long long* simulations) {
+    char* save = NULL;
+    char* token = strtok_r(line, ";", &save);
+    if (!token) return false;
+
+    char* end;
+    long id = strtol(token, &end, 10);
+    int a;
+    if (end != token && *trim(end) == '\0') {
+        a = (int)id - 1;
+        token = strtok_r(NULL, ";", &save);
+    } else {
+        a = *next_agent;
+        while (a < m->agent_count && (!m->agents[a].alive || m->agents[a].player != player)) a++;
+    }
+    if (a < 0 || a >= m->agent_count) return false;
+    Agent* agent = &m->agents[a];
+    if (!agent->alive || agent->player != player || agent->commanded) return false;
+    agent->commanded = true;
+    *next_agent = a + 1;
+
+    for (; token; token = strtok_r(NULL, ";", &save)) {
+        token = trim(token);
+        int x, y, target;
+        char extra;
+        if (!strncmp(token, "MESSAGE", 7)) {
+            for (char* word = token + 7; *word; word++) {
+                if (word[0] == 's' && isspace((unsigned char)word[-1]) && isdigit((unsigned char)word[1]))
+                    *simulations = atoll(word + 1);
+            }
+        } else if (sscanf(token, "MOVE %d %d %c", &x, &y, &extra) == 2) {
+            if (agent->moving || !inside(m, x, y)) return false;
+            agent->moving = true;
+            agent->move_x = x;
+            agent->move_y = y;
+        } else if (agent->action != ACTION_NONE) {
+            return false;
+        } else if (sscanf(token, "SHOOT %d %c", &target, &extra) == 1) {
+            if (target < 1 || target > m->agent_count) return false;
+            agent->action = ACTION_SHOOT;
+            agent->target_x_or_id = target - 1;
+        } else if (sscanf(token, "THROW %d %d %c", &x, &y, &extra) == 2) {
+            if (!inside(m, x, y)) return false;
+            agent->action = ACTION_THROW;
+            agent->target_x_or_id = x;
+            agent->target_y = y;
+        } else if (!strcmp(token, "HUNKER_DOWN")) {
+            agent->action = ACTION_HUNKER;
+        } else if (*token) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// --- Matches ---
+typedef struct {
+    int winner;                     // bot 0 (A), 1 (B), -1 for a draw
+    int turns;
+    bool failed[2];                 // timeout, invalid command or crash
+    double latency_ms[2][MAX_TURNS];
+    long long simulations[2][MAX_TURNS];   // -1 when not reported
+} MatchResult;
+
+const char* bot_commands[2];
+double timeout_ms = 0.0;
+
+// Bot b plays player b ^ swap.
+void play_match(unsigned long long seed, int swap, MatchResult* result) {
+    static __thread char text[LINE_SIZE * 16];
+    char line[LINE_SIZE];
+    Match m;
+    BotProcess bots[2];
+    generate_match(&m, seed);
+    memset(result, 0, sizeof(*result));
+    result->winner = -1;
+    for (int b = 0; b < 2; b++) {
+        start_bot(&bots[b], bot_commands[b]);
+        int n = write_init_input(&m, b ^ swap, text);
+        result->failed[b] = !send_to_bot(&bots[b], text, n);
+    }
+
+    int turn = 0;
+    while (turn < MAX_TURNS && !result->failed[0] && !result->failed[1]) {
+        for (int a = 0; a < m.agent_count; a++) {
+            Agent* agent = &m.agents[a];
+            agent->commanded = agent->moving = false;
+            agent->action = ACTION_NONE;
+        }
+        for (int b = 0; b < 2; b++) {
+            int player = b ^ swap;
+            int n = write_turn_input(&m, player, text);
+            double start = wall_ms();
+            double deadline = (timeout_ms > 0) ? start + (turn == 0 ? 20.0 * timeout_ms : timeout_ms) : 0.0;
+            long long simulations = -1;
+            int next_agent = 0;
+            bool ok = send_to_bot(&bots[b], text, n);
+            for (int k = alive_agents(&m, player); k > 0 && ok; k--) {
+                ok = read_bot_line(&bots[b], line, deadline) && parse_command(&m, player, line, &next_agent, &simulations);
+            }
+            result->latency_ms[b][turn] = wall_ms() - start;
+            result->simulations[b][turn] = simulations;
+            if (!ok) result->failed[b] = true;
+        }
+        // The failed turn still counts, so timeouts show in the latencies.
+        if (result->failed[0] || result->failed[1]) {
+            turn++;
+            break;
+        }
+
+        resolve_turn(&m);
+        turn++;
+        int alive[2] = {alive_agents(&m, swap), alive_agents(&m, !swap)};
+        if (!alive[0] || !alive[1]) {
+            if (alive[0] != alive[1]) result->winner = alive[0] ? 0 : 1;
+            else if (m.score[swap] != m.score[!swap]) result->winner = m.score[swap] > m.score[!swap] ? 0 : 1;
+            break;
+        }
+        if (abs(m.score[0] - m.score[1]) >= WIN_MARGIN || turn == MAX_TURNS) {
+            if (m.score[swap] != m.score[!swap]) result->winner = m.score[swap] > m.score[!swap] ? 0 : 1;
+            break;
+        }
+    }
+    if (result->failed[0] != result->failed[1]) result->winner = result->failed[0] ? 1 : 0;
+    result->turns = turn;
+    for (int b = 0; b < 2; b++) stop_bot(&bots[b]);
+}
+
+// --- Arena ---
+typedef struct {
+    double* values;
+    int count, capacity;
+} Samples;
+
+static void add_sample(Samples* s, double value) {
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? 2 * s->capacity : 1024;
+        s->values = realloc(s->values, s->capacity * sizeof(double));
+        if (!s->values) ERROR("realloc")
+    }
+    s->values[s->count++] = value;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const Samples* s, double p) {
+    if (s->count == 0) return 0.0;
+    int k = (int)ceil(p / 100.0 * s->count) - 1;
+    if (k < 0) k = 0;
+    return s->values[k];
+}
+
+typedef struct {
+    pthread_mutex_t mutex;
+    int next_match, match_count;
+    unsigned long long seed;
+    int wins[2], draws, failures[2];
+    long long turns;
+    Samples latency[2];          // every turn but the first
+    Samples first_latency[2];
+    Samples simulations[2];
+} Arena;
+
+Arena arena = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static void* arena_worker(void* unused) {
+    (void)unused;
+    MatchResult* result = malloc(sizeof(MatchResult));
+    if (!result) ERROR("malloc")
+    while (1) {
+        pthread_mutex_lock(&arena.mutex);
+        int i = arena.next_match++;
+        pthread_mutex_unlock(&arena.mutex);
+        if (i >= arena.match_count) break;
+
+        play_match(arena.seed + i / 2, i % 2, result);
+
+        pthread_mutex_lock(&arena.mutex);
+        if (result->winner < 0) arena.draws++;
+        else arena.wins[result->winner]++;
+        arena.turns += result->turns;
+        for (int b = 0; b < 2; b++) {
+            arena.failures[b] += result->failed[b];
+            for (int t = 0; t < result->turns; t++) {
+                add_sample(t ? &arena.latency[b] : &arena.first_latency[b], result->latency_ms[b][t]);
+                if (result->simulations[b][t] >= 0) add_sample(&arena.simulations[b], result->simulations[b][t]);
+            }
+        }
+        pthread_mutex_unlock(&arena.mutex);
+    }
+    free(result);
+    return NULL;
+}
+
+void print_report() {
+    int n = arena.match_count;
+    printf("%d matches, %.1f turns on average, %d draws\n", n, n ? (double)arena.turns / n : 0.0, arena.draws);
+    for (int b = 0; b < 2; b++) {
+        Samples* latency = &arena.latency[b];
+        Samples* first = &arena.first_latency[b];
+        Samples* simulations = &arena.simulations[b];
+        qsort(latency->values, latency->count, sizeof(double), compare_double);
+        qsort(first->values, first->count, sizeof(double), compare_double);
+        qsort(simulations->values, simulations->count, sizeof(double), compare_double);
+
+        printf("%c \"%s\": %d wins (%.1f%%), %d failures\n", 'A' + b, bot_commands[b], arena.wins[b],
+               n ? 100.0 * arena.wins[b] / n : 0.0, arena.failures[b]);
+        printf("  turn ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f  (first turn max %.2f)\n",
+               percentile(latency, 50), percentile(latency, 90), percentile(latency, 99),
+               percentile(latency, 100), percentile(first, 100));
+        if (simulations->count) {
+            double sum = 0.0;
+            for (int k = 0; k < simulations->count; k++) sum += simulations->values[k];
+            printf("  simulations per turn: mean %.0f  p10 %.0f  p50 %.0f  p90 %.0f\n", sum / simulations->count,
+                   percentile(simulations, 10), percentile(simulations, 50), percentile(simulations, 90));
+        } else {
+            printf("  simulations per turn: not reported\n");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    arena.match_count = 100;
+    arena.seed = 1;
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "--bot-a") && a + 1 < argc) bot_commands[0] = argv[++a];
+        else if (!strcmp(argv[a], "--bot-b") && a + 1 < argc) bot_commands[1] = argv[++a];
+        else if (!strcmp(argv[a], "--matches") && a + 1 < argc) arena.match_count = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--jobs") && a + 1 < argc) jobs = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--seed") && a + 1 < argc) arena.seed = strtoull(argv[++a], NULL, 10);
+        else if (!strcmp(argv[a], "--timeout") && a + 1 < argc) timeout_ms = atof(argv[++a]);
+        else ERROR("usage: referee --bot-a CMD --bot-b CMD [--matches N] [--jobs N] [--seed S] [--timeout MS]")
+    }
+    if (!bot_commands[0] || !bot_commands[1]) ERROR("--bot-a and --bot-b are required")
+    if (jobs < 1) jobs = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t threads[jobs];
+    for (int t = 0; t < jobs; t++) {
+        if (pthread_create(&threads[t], NULL, arena_worker, NULL)) ERROR("pthread_create")
+    }
+    for (int t = 0; t < jobs; t++) pthread_join(threads[t], NULL);
+    print_report();
+    return 0;
+}